@@ -0,0 +1,107 @@
+#include "../include/threaded_rands.hpp"
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <iomanip>
+#include <thread>
+
+// Measures how the throughput of generate_2D scales from a single thread up to
+// every hardware thread. Each thread fills a row of the same length, so with
+// perfect scaling the time per fill stays flat and the throughput rises linearly.
+
+int main(int argc, char* argv[])
+{
+	// Available generators are the xoro128, pcg, jsf, pcg_setseq, philox, threefry, threefry13,
+	// xoshiro256pp, xoshiro256ss, sfc, chacha, chacha12 and chacha8 PRNGs
+	generator_type selection = generator_type::xoro128;
+
+	if(argc > 1)
+	{
+		const std::string name = argv[1];
+		if(name == "pcg")
+			selection = generator_type::pcg;
+		else if(name == "jsf")
+			selection = generator_type::jsf;
+		else if(name == "pcg_setseq")
+			selection = generator_type::pcg_setseq;
+		else if(name == "philox")
+			selection = generator_type::philox;
+		else if(name == "threefry")
+			selection = generator_type::threefry;
+		else if(name == "threefry13")
+			selection = generator_type::threefry13;
+		else if(name == "xoshiro256pp")
+			selection = generator_type::xoshiro256pp;
+		else if(name == "xoshiro256ss")
+			selection = generator_type::xoshiro256ss;
+		else if(name == "sfc")
+			selection = generator_type::sfc;
+		else if(name == "chacha")
+			selection = generator_type::chacha;
+		else if(name == "chacha12")
+			selection = generator_type::chacha12;
+		else if(name == "chacha8")
+			selection = generator_type::chacha8;
+	}
+
+	using rand_type = std::uint64_t;
+	using state_type = std::uint64_t;
+
+	// Rands per thread for each fill and how many fills to time
+	const std::size_t n_rands = 1 << 20;
+	const unsigned int n_reps = 20;
+
+	const unsigned int max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+	// Thread counts to run, doubling up to the number of hardware threads
+	std::vector<unsigned int> thread_counts;
+	for(unsigned int n = 1; n < max_threads; n *= 2)
+		thread_counts.push_back(n);
+	thread_counts.push_back(max_threads);
+
+	using hr_clock = std::chrono::high_resolution_clock;
+
+	double single_rate = 0;
+
+	std::vector<std::string> results;
+
+	for(const unsigned int n_threads : thread_counts)
+	{
+		Threaded_rands<rand_type, state_type> my_generator(n_threads, selection);
+
+		std::vector<std::vector<rand_type>> vector_storage(n_threads, std::vector<rand_type>(n_rands));
+
+		// Warm up so page faults and thread creation aren't timed
+		my_generator.generate_2D(vector_storage);
+
+		auto t_start = hr_clock::now();
+
+		for(unsigned int r = 0; r < n_reps; r++)
+			my_generator.generate_2D(vector_storage);
+
+		auto t_end = hr_clock::now();
+
+		const double seconds = std::chrono::duration<double>(t_end - t_start).count();
+		const double rate = double(n_threads) * n_rands * n_reps / seconds;
+
+		if(n_threads == 1)
+			single_rate = rate;
+
+		std::ostringstream line;
+		line << std::setw(8) << n_threads 
+			 << std::setw(16) << std::fixed << std::setprecision(1) << rate / 1e6
+			 << std::setw(12) << std::setprecision(2) << rate / single_rate
+			 << std::setw(12) << std::setprecision(2) << rate / (single_rate * n_threads);
+
+		results.push_back(line.str());
+	}
+
+	std::cout << "\nSIMD path : " << Threaded_rands<rand_type, state_type>::simd_path() << "\n";
+
+	std::cout << "\n" << std::setw(8) << "threads" << std::setw(16) << "Mrands/s" 
+			  << std::setw(12) << "speedup" << std::setw(12) << "efficiency" << "\n";
+
+	for(const auto& line : results)
+		std::cout << line << "\n";
+}
@@ -0,0 +1,191 @@
+#ifndef CPU_FEATURES_HPP
+#define CPU_FEATURES_HPP
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define THREADED_RANDS_X86_SIMD 1
+#include <cpuid.h>
+#endif
+
+// ======================================
+// 			  CPU features
+// ======================================
+
+// The bulk generator kernels are built several times over for different
+// instruction sets using GCC's target attribute, so the library can still be
+// compiled without -march and one binary runs at full speed on any x86-64 CPU.
+// The features of the CPU are read with cpuid the first time a kernel is
+// needed and each kernel then binds a function pointer to the best version
+// it can run.
+
+// The version used can be forced by setting THREADED_RANDS_SIMD to one of
+// generic, sse4.2, avx2 or avx512, which is useful for testing. Asking for
+// more than the CPU supports falls back to the best it does support.
+
+// Instruction sets there are kernels for, in increasing order
+// generic - whatever the compiler targets by default (SSE2 on x86-64)
+// sse42   - SSE4.2
+// avx2    - AVX2 and BMI2, 256-bit integer vectors and the flag-free BMI2 shifts and multiplies
+// avx512  - 512-bit vectors with native rotates (F, DQ, BW and VL) along with AVX2 and BMI2
+enum class simd_level{generic, sse42, avx2, avx512};
+
+#if defined(THREADED_RANDS_X86_SIMD)
+#define THREADED_RANDS_TARGET_SSE42 __attribute__((target("sse4.2")))
+#if defined(__clang__)
+#define THREADED_RANDS_TARGET_AVX2 __attribute__((target("avx2,bmi2")))
+#else
+// GCC keeps a 512-bit vector that lives across loop iterations in memory when
+// the target has no 512-bit registers. With its default tuning it writes each
+// vector back 16 bytes at a time and reads it as 32-byte loads, stalling every
+// step on the failed store forwarding. The skylake-avx512 tuning moves them
+// 32 bytes at a time, which runs the 8-lane kernels around 3 times faster
+#define THREADED_RANDS_TARGET_AVX2 __attribute__((target("avx2,bmi2,tune=skylake-avx512")))
+#endif
+#define THREADED_RANDS_TARGET_AVX512 __attribute__((target("avx512f,avx512dq,avx512bw,avx512vl,avx2,bmi2")))
+#else
+// Everything is built for the default target and only the generic versions are used
+#define THREADED_RANDS_TARGET_SSE42
+#define THREADED_RANDS_TARGET_AVX2
+#define THREADED_RANDS_TARGET_AVX512
+#endif
+
+struct cpu_features
+{
+	bool sse42 = false;
+	bool avx2 = false;
+	bool bmi2 = false;
+	// F, DQ, BW and VL
+	bool avx512 = false;
+};
+
+// Read the features of this CPU with cpuid. The AVX registers are only usable if
+// the OS saves them on a context switch, which is checked with xgetbv.
+inline cpu_features detect_cpu_features()
+{
+	cpu_features features;
+
+#if defined(THREADED_RANDS_X86_SIMD)
+	unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+
+	if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return features;
+
+	features.sse42 = ecx & bit_SSE4_2;
+
+	const bool avx = (ecx & bit_AVX) && (ecx & bit_OSXSAVE);
+
+	unsigned long long xcr0 = 0;
+	if(avx)
+	{
+		unsigned int lo = 0, hi = 0;
+		__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+		xcr0 = (static_cast<unsigned long long>(hi) << 32) | lo;
+	}
+
+	// XMM and YMM state, then the opmask and ZMM state on top
+	const bool ymm_saved = (xcr0 & 0x6) == 0x6;
+	const bool zmm_saved = (xcr0 & 0xe6) == 0xe6;
+
+	if(__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+	{
+		features.bmi2 = ebx & bit_BMI2;
+		features.avx2 = avx && ymm_saved && (ebx & bit_AVX2);
+		features.avx512 = avx && zmm_saved && (ebx & bit_AVX512F) && (ebx & bit_AVX512DQ) &&
+						  (ebx & bit_AVX512BW) && (ebx & bit_AVX512VL);
+	}
+#endif
+
+	return features;
+}
+
+// The best level the CPU supports
+inline simd_level detect_simd_level()
+{
+	const cpu_features features = detect_cpu_features();
+
+	if(features.avx512 && features.avx2 && features.bmi2)
+		return simd_level::avx512;
+	if(features.avx2 && features.bmi2)
+		return simd_level::avx2;
+	if(features.sse42)
+		return simd_level::sse42;
+
+	return simd_level::generic;
+}
+
+inline const char* simd_level_name(const simd_level level)
+{
+	switch(level)
+	{
+		case simd_level::avx512:
+			return "avx512";
+		case simd_level::avx2:
+			return "avx2";
+		case simd_level::sse42:
+			return "sse4.2";
+		case simd_level::generic:
+		default:
+			return "generic";
+	}
+}
+
+// The detected level, lowered to the one named in THREADED_RANDS_SIMD if that is set
+inline simd_level select_simd_level()
+{
+	const simd_level detected = detect_simd_level();
+
+	const char* forced = std::getenv("THREADED_RANDS_SIMD");
+	if(forced == nullptr || *forced == '\0')
+		return detected;
+
+	for(const simd_level level : {simd_level::generic, simd_level::sse42, simd_level::avx2, simd_level::avx512})
+	{
+		if(std::strcmp(forced, simd_level_name(level)) != 0)
+			continue;
+
+		if(level > detected)
+		{
+			std::cerr << "THREADED_RANDS_SIMD asks for " << forced << " but this CPU only supports "
+					  << simd_level_name(detected) << ", using " << simd_level_name(detected) << ".\n";
+			return detected;
+		}
+
+		return level;
+	}
+
+	std::cerr << "Unknown THREADED_RANDS_SIMD value " << forced << ", expected generic, sse4.2, avx2 or avx512."
+			  << " Using " << simd_level_name(detected) << ".\n";
+
+	return detected;
+}
+
+// The level the kernels run at, only worked out once
+inline simd_level active_simd_level()
+{
+	static const simd_level level = select_simd_level();
+
+	return level;
+}
+
+// Pick the version of a kernel for the active level
+template<typename F>
+F select_kernel(const F generic, const F sse42, const F avx2, const F avx512)
+{
+	switch(active_simd_level())
+	{
+		case simd_level::avx512:
+			return avx512;
+		case simd_level::avx2:
+			return avx2;
+		case simd_level::sse42:
+			return sse42;
+		case simd_level::generic:
+		default:
+			return generic;
+	}
+}
+
+#endif
@@ -5,6 +5,21 @@
 #include "pcg/randutils.hpp"
 #include "pcg/pcg_random.hpp"
 
+#include "simd_kernels.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <type_traits>
+#include <utility>
+
+// All generator state is kept in fixed-size, trivially-copyable members and any
+// constants are static, so generators are cheap to copy and can be stored in
+// bulk without any heap allocations. This is checked at the bottom of this file.
+// The exception is pcg_unique, whose stream comes from its own address so a copy
+// gives a different sequence.
+
 
 // TODO - Add support for older version of C++
 
@@ -19,30 +34,6 @@
 
 // };
 
-// A small helper class to allow the counting of instances
-// of 32-bit JSF objects
-// See https://en.wikipedia.org/wiki/Curiously_recurring_template_pattern
-template <typename T>
-class jsf_counter
-{
-public:
-    jsf_counter()
-    {
-        objects_created++;
-    }
-    
-protected:
-    ~jsf_counter()
-    {
-        --objects_alive;
-    }
-    static int objects_created;
-    static int objects_alive;
-};
-template <typename T> int jsf_counter<T>::objects_created(0);
-template <typename T> int jsf_counter<T>::objects_alive(0);
-
-
 // ======================================
 //	 		 	SplitMix64 
 // ======================================
@@ -51,9 +42,6 @@ template<typename state_type>
 class splitmix64
 {
 protected:
-	randutils::auto_seed_256 seeds;
-	std::array<state_type, 2> seed_array;
-
 	// Want an actual 64-bit int here
 	std::uint64_t split_seed = 1;
 
@@ -61,12 +49,16 @@ public:
 	splitmix64()
 	{
 		// Seeds from a decent entropy source
+		randutils::auto_seed_256 seeds;
+		std::array<std::uint32_t, 2> seed_array;
 		seeds.generate(seed_array.begin(), seed_array.end());
 
 		// Add two 32-bit ints together to create a 64-bit
 		split_seed = uint64_t(seed_array[0]) << 32 | seed_array[1];
 	}
 
+	explicit splitmix64(const std::uint64_t seed) : split_seed{seed} {}
+
 	state_type operator()() { return get_rand(); }
 
 	state_type get_rand()
@@ -93,16 +85,21 @@ template <typename state_type, std::size_t S_SIZE = 8*sizeof(state_type)>
 class xoroshiro128
 {
 protected:
-	unsigned int thread_no = 0;	
+	static constexpr unsigned int STYPE_BITS = 8*sizeof(state_type);
 	
-	const unsigned int STYPE_BITS = 8*sizeof(state_type);
+	static constexpr std::size_t n_xoro_seeds = (STYPE_BITS == 64 ? 2 : 4);
 	
-	const std::size_t n_xoro_seeds = (STYPE_BITS == 64 ? 2 : 4);
-	
-	std::vector<state_type> seed_array;
+	unsigned int thread_no = 0;	
+
+	std::array<state_type, n_xoro_seeds> seed_array;
+
+	// State for the SIMD bulk fill, only used by the 64-bit generator
+	xoro128_lanes lanes;
+
+	xoroshiro128() = default;
 
 	// Circular rotation function
-	inline state_type rotl(const state_type x, int k) {return (x << k) | (x >> (STYPE_BITS - k));}
+	static inline state_type rotl(const state_type x, int k) {return (x << k) | (x >> (STYPE_BITS - k));}
 	
 	// Create a seeded SplitMix64 instance to generate
 	// further seeds for this generator.
@@ -119,14 +116,14 @@ protected:
 	typename std::enable_if<S == 32, void>::type
 	jump_stream()
 	{
-		const uint32_t JUMP[] = { 0x8764000b, 0xf542d2d3, 0x6fa035c3, 0x77f2db5b };
+		static constexpr uint32_t JUMP[] = { 0x8764000b, 0xf542d2d3, 0x6fa035c3, 0x77f2db5b };
 
 		uint32_t s0 = 0;
 		uint32_t s1 = 0;
 		uint32_t s2 = 0;
 		uint32_t s3 = 0;
 
-		for(int i = 0; i < sizeof JUMP / sizeof *JUMP; i++)
+		for(std::size_t i = 0; i < sizeof JUMP / sizeof *JUMP; i++)
 		{
 			for(int b = 0; b < 32; b++) 
 			{
@@ -154,17 +151,34 @@ protected:
 	{
 		// static const uint64_t JUMP[] = { 0xbeac0467eba5facb, 0xd86b048b86aa9922 };
 		// Updated values - 2018-10-15
-		std::cout << "64-bit version\n";
-		const state_type JUMP[] = { 0xdf900294d8f554a5, 0x170865df4b3201fc };
+		static constexpr state_type JUMP[] = { 0xdf900294d8f554a5, 0x170865df4b3201fc };
+
+		jump_by(JUMP);
+	}
+
+	// Same as calling get_rand 2^96 times, used to give each SIMD lane its own stream
+	template <std::size_t S = S_SIZE>
+	typename std::enable_if<S == 64, void>::type 
+	long_jump_stream()
+	{
+		static constexpr state_type LONG_JUMP[] = { 0xd2a98b26625eee7b, 0xdddf9b1090aa7ac1 };
 
+		jump_by(LONG_JUMP);
+	}
+
+	// Apply one of the jump polynomials above to the 64-bit state
+	template <std::size_t S = S_SIZE>
+	typename std::enable_if<S == 64, void>::type 
+	jump_by(const state_type (&jump)[2])
+	{
 		uint64_t s0 = 0;
 		uint64_t s1 = 0;
 
-		for(int i = 0; i < sizeof JUMP / sizeof *JUMP; i++)
+		for(std::size_t i = 0; i < 2; i++)
 		{
 		for(int b = 0; b < 64; b++) 
 			{
-				if (JUMP[i] & UINT64_C(1) << b) 
+				if (jump[i] & UINT64_C(1) << b) 
 				{
 					s0 ^= seed_array[0];
 					s1 ^= seed_array[1];
@@ -177,12 +191,30 @@ protected:
 		seed_array[1] = s1;
 	}
 
+	// Lane l starts l + 1 long jumps (2^96 draws each) on from this generator's own
+	// stream, so the lanes don't overlap each other or this generator's stream.
+	// Each thread is seeded separately from entropy, so nothing keeps them clear of
+	// another thread's stream or lanes beyond the odds of two random seeds landing
+	// within 2^96 draws of each other in a period of 2^128.
+	template <std::size_t S = S_SIZE>
+	typename std::enable_if<S == 64, void>::type 
+	seed_lanes()
+	{
+		xoroshiro128 lane_gen = *this;
+
+		for(std::size_t l = 0; l < simd::n_lanes; l++)
+		{
+			lane_gen.long_jump_stream();
+			lanes.s0[l] = lane_gen.seed_array[0];
+			lanes.s1[l] = lane_gen.seed_array[1];
+		}
+	}
+
 	
 public:
 	xoroshiro128(const unsigned int thread_id) : thread_no{thread_id}
 	{
 		std::cout << "Creating xoroshiro128 generator for thread : " << thread_id << "\n";
-		seed_array.resize(n_xoro_seeds);
 		auto_seed();		
 		unsigned int jump_factor = 2*thread_id;
 
@@ -190,9 +222,33 @@ public:
 		if(jump_factor > 0)
 		{
 			// std::cout << "Jumping stream for xoroshiro128+ generator on thread : " << thread_id << "\n";
-			for(int x = 0; x < jump_factor; x++)
+			for(unsigned int x = 0; x < jump_factor; x++)
 				jump_stream();
 		}
+
+		if constexpr(S_SIZE == 64)
+			seed_lanes();
+	}
+
+	// A generator seeded from a hash of a seed and a stream number rather than from
+	// entropy, with its lanes long jumps apart as above. Used for the fixed blocks of
+	// Threaded_rands' block partitioning, which can't jump each block's stream on
+	// from the one before without the cost growing with the number of blocks
+	static xoroshiro128 substream(const std::uint64_t seed, const std::uint64_t stream)
+	{
+		xoroshiro128 gen;
+
+		splitmix64<std::uint64_t> stream_hash(stream);
+		splitmix64<std::uint64_t> seed_gen(seed ^ stream_hash());
+
+		// Consecutive SplitMix64 outputs are never both zero
+		for(auto& s : gen.seed_array)
+			s = static_cast<state_type>(seed_gen());
+
+		if constexpr(S_SIZE == 64)
+			gen.seed_lanes();
+
+		return gen;
 	}
 
 	// 32-bit generator
@@ -233,7 +289,12 @@ public:
 		return result;
 	}
 
-	state_type operator()() {return get_rand(0);}
+	state_type operator()() {return get_rand();}
+
+	// The bulk fill's 8 lanes are long jumps apart, see seed_lanes()
+	template <typename Out, std::size_t S = S_SIZE>
+	typename std::enable_if<S == 64, void>::type
+	fill(const Out& out, const std::size_t n) { xoro128_fill(lanes, out, n); }
 
 };
 
@@ -248,6 +309,11 @@ public:
 
 // Here we're using pcg32/64_unique for statistically independent streams
 
+// The stream is taken from the address of the object, so a copy (or a moved
+// generator) carries on from the same state on a different stream and doesn't
+// repeat the original's sequence. The object is held in place for as long as it
+// is used. pcg_setseq below is the same generator with an explicit stream.
+
 // For the PCG types
 // typedef pcg_engines::unique_xsh_rr_64_32        pcg32_unique;
 // typedef pcg_engines::unique_xsl_rr_128_64       pcg64_unique;
@@ -267,6 +333,9 @@ protected:
 
 	unsigned int thread_no = 0;
 
+	// State for the SIMD bulk fill, only used by the 32-bit generator
+	pcg32_lanes lanes;
+
 public:
 	pcg_unique(const unsigned int thread_id) : thread_no{thread_id}
 	{
@@ -275,12 +344,21 @@ public:
 		pcg_extras::seed_seq_from<std::random_device> seed_source;	
 
 		pcg_gen = pcg_type(seed_source);
+
+		// Each lane gets its own state and stream from the same entropy source
+		if constexpr(8*sizeof(state_type) == 32)
+			lanes.seed([&]{ std::uint32_t words[2]; seed_source.generate(words, words + 2); return std::uint64_t(words[0]) << 32 | words[1]; });
 	}
 
 	state_type get_rand() {	return pcg_gen(); }
 
 	state_type operator()() {return get_rand();}
 
+	// The bulk fill's 16 pcg32 lanes each have their own state and stream from the entropy source
+	template <typename Out, typename T = state_type>
+	typename std::enable_if<8*sizeof(T) == 32, void>::type
+	fill(const Out& out, const std::size_t n) { pcg32_fill(lanes, out, n); }
+
 
 // // Make the class non-copyable
  //    pcg_unique(pcg_unique const&) = delete;
@@ -292,6 +370,79 @@ public:
 };
 
 
+// ======================================
+// 			pcg_setseq
+// ======================================
+
+// This is a wrapper for the pcg32/64 (setseq) PRNG by Prof. Melissa E. O'Neill
+// http://www.pcg-random.org/
+
+// Unlike pcg_unique the stream isn't derived from the address of the object so
+// moving the generator around doesn't change its output. The stream is selected
+// by the thread id and the starting state is hashed from a master seed and the
+// thread id, so the same master seed always gives the same numbers on each thread.
+// Seeding doesn't touch any entropy source.
+
+template<typename state_type>
+class pcg_setseq
+{
+protected:	
+	using pcg_type = typename std::conditional<(8*sizeof(state_type) == 64), pcg64, pcg32>::type;
+
+	pcg_type pcg_gen;
+
+	unsigned int thread_no = 0;
+
+	// State for the SIMD bulk fill, only used by the 32-bit generator
+	pcg32_lanes lanes;
+
+	pcg_setseq() = default;
+
+	// The lanes take their states and (random, odd) stream increments from the
+	// rest of the SplitMix64 sequence, so they are just as reproducible
+	void seed_lanes(splitmix64<std::uint64_t>& seed_gen)
+	{
+		if constexpr(8*sizeof(state_type) == 32)
+			lanes.seed(seed_gen);
+	}
+
+public:
+	pcg_setseq(const unsigned int thread_id, const std::uint64_t master_seed) : thread_no{thread_id}
+	{
+		std::cout << "Creating PCG setseq generator for thread : " << thread_id << "\n";
+
+		// Hash the master seed and thread id so neighbouring threads
+		// don't start from the same state on different streams
+		splitmix64<std::uint64_t> seed_gen(master_seed + thread_id);
+
+		pcg_gen = pcg_type(seed_gen(), thread_id);
+
+		seed_lanes(seed_gen);
+	}
+
+	// A generator for any of the 2^63 streams, hashed from a seed in the same way.
+	// Used for the fixed blocks of Threaded_rands' block partitioning
+	static pcg_setseq substream(const std::uint64_t seed, const std::uint64_t stream)
+	{
+		pcg_setseq gen;
+		splitmix64<std::uint64_t> seed_gen(seed + stream);
+		gen.pcg_gen = pcg_type(seed_gen(), stream);
+		gen.seed_lanes(seed_gen);
+
+		return gen;
+	}
+
+	state_type get_rand() {	return pcg_gen(); }
+
+	state_type operator()() {return get_rand();}
+
+	// The bulk fill's 16 pcg32 lanes are seeded from the SplitMix64 that seeded this generator
+	template <typename Out, typename T = state_type>
+	typename std::enable_if<8*sizeof(T) == 32, void>::type
+	fill(const Out& out, const std::size_t n) { pcg32_fill(lanes, out, n); }
+};
+
+
 // ======================================
 // 				JSF64
 // ======================================
@@ -307,26 +458,18 @@ public:
 // https://gist.github.com/imneme/85cff47d4bad8de6bdeb671f9c76c814
 
 template<typename state_type>
-class jsf : jsf_counter<state_type>
+class jsf
 {
 protected:
-	
-	unsigned int p, q, r;	
-
-	unsigned int thread_no = 0;
-
-	state_type a_, b_, c_, d_;
-
 	// Number of bits in the state type
-	const unsigned int STYPE_BITS = 8*sizeof(state_type);
-
-	state_type rotate(state_type x, unsigned int k) { return (x << k) | (x >> (STYPE_BITS - k)); }
+	static constexpr unsigned int STYPE_BITS = 8*sizeof(state_type);
 
 	// There are only 2 sets of constants for the 64-bit generator so we won't change those
-	std::array<unsigned int, 3> gen_64bit_constants = {7, 13, 37};
-	// These can be used to create statistically different streams for the 32-bit generator
+	static constexpr unsigned int gen_64bit_constants[3] = {7, 13, 37};
 
-	std::vector<std::vector<unsigned int>> gen_32bit_constants =  {{3, 14, 24},
+	// These can be used to create statistically different streams for the 32-bit generator
+	static constexpr unsigned int n_32bit_constants = 23;
+	static constexpr unsigned int gen_32bit_constants[n_32bit_constants][3] = {{3, 14, 24},
 									{3, 25, 15},
 									{4, 15, 24},
 									{6, 16, 28},
@@ -349,43 +492,74 @@ protected:
 									{25, 14,  3},
 									{27, 16,  6},
 									{27, 16,  7}};
+	
+	unsigned int p, q, r;	
 
+	unsigned int thread_no = 0;
 
-public:
-	jsf(const unsigned int thread_id) : thread_no{thread_id}, a_{0xf1ea5eed}
-	{
-		std::cout << "Creating JSF generator for thread id : " << thread_id << " \n";
+	state_type a_, b_, c_, d_;
 
-		splitmix64<state_type> seed_gen;
+	// State for the SIMD bulk fill, only used by the 64-bit generator
+	jsf_lanes lanes;
 
-		// Seed the generator using the SplitMix64 object
+	jsf() = default;
+
+	// Take the constants for a stream and seed the generator and its lanes from
+	// seed_gen. The 32-bit generator picks its set of constants from the stream,
+	// rolling over if there are more than 23
+	void seed_stream(const unsigned int stream, splitmix64<state_type>& seed_gen)
+	{
+		const unsigned int (&constants)[3] = (STYPE_BITS == 32) ? gen_32bit_constants[stream % n_32bit_constants] 
+																: gen_64bit_constants;
+		p = constants[0];
+		q = constants[1];
+		r = constants[2];
+
+		a_ = 0xf1ea5eed;
 		seed(seed_gen());
 
-		// Keep track of how many instances of the generator
-		// we have for the constants
-		if(STYPE_BITS == 32)
+		if constexpr(STYPE_BITS == 64)
+			seed_lanes(seed_gen);
+	}
+
+	// Each lane is seeded like a generator of its own from the next
+	// values of the SplitMix64 used to seed this generator
+	void seed_lanes(splitmix64<state_type>& seed_gen)
+	{
+		for(std::size_t l = 0; l < simd::n_lanes; l++)
 		{
-			// Although this will also count 64-bit instances it
-			// shouldn't matter for small amounts of objects
-			unsigned int jsf32_instances = jsf_counter<state_type>::objects_created;
+			lanes.a[l] = 0xf1ea5eed;
+			lanes.b[l] = lanes.c[l] = lanes.d[l] = seed_gen();
+		}
 
-			// Roll over if we have more than 23 instances
-			unsigned int jsf_constants = (jsf32_instances > 22) ? 0 : jsf32_instances;
+		// The same 20 rounds seed() runs
+		std::uint64_t discard[20 * simd::n_lanes];
+		jsf_fill(lanes, simd::int_out<std::uint64_t>{discard}, 20 * simd::n_lanes);
+	}
 
-			// For zero-order array access
-			if(jsf_constants > 0)
-				jsf_constants -= 1;
+	static state_type rotate(state_type x, unsigned int k) { return (x << k) | (x >> (STYPE_BITS - k)); }
 
-			p = gen_32bit_constants[jsf_constants][0];
-			q = gen_32bit_constants[jsf_constants][1];
-			r = gen_32bit_constants[jsf_constants][2];
-		}
-		if(STYPE_BITS == 64)
-		{			
-			p = 7;
-			q = 13;
-			r = 37;
-		}
+public:
+	jsf(const unsigned int thread_id) : thread_no{thread_id}
+	{
+		std::cout << "Creating JSF generator for thread id : " << thread_id << " \n";
+
+		// Seed the generator using the SplitMix64 object
+		splitmix64<state_type> seed_gen;
+		seed_stream(thread_id, seed_gen);
+	}
+
+	// A generator seeded from a hash of a seed and a stream number rather than from
+	// entropy. Used for the fixed blocks of Threaded_rands' block partitioning
+	static jsf substream(const std::uint64_t seed, const std::uint64_t stream)
+	{
+		jsf gen;
+
+		splitmix64<std::uint64_t> stream_hash(stream);
+		splitmix64<state_type> seed_gen(seed ^ stream_hash());
+		gen.seed_stream(static_cast<unsigned int>(stream % n_32bit_constants), seed_gen);
+
+		return gen;
 	}
 
 	void seed(const state_type seed)
@@ -415,6 +589,705 @@ public:
 
     state_type operator()() { return get_rand(); }
 
+	// The bulk fill's 8 lanes are each seeded from the next value of the SplitMix64 that
+	// seeded this generator
+	template <typename Out, typename T = state_type>
+	typename std::enable_if<8*sizeof(T) == 64, void>::type
+	fill(const Out& out, const std::size_t n) { jsf_fill(lanes, out, n); }
+
+};
+
+// ======================================
+// 			  Philox4x32-10
+// ======================================
+
+// The counter-based generator by John Salmon, Mark Moraes, Ron Dror and David Shaw,
+// as in their Random123 library
+// https://www.deshawresearch.com/resources_random123.html
+
+// Each 128-bit block of output is worked out from the key and the block's counter
+// alone (see philox4x32_10 in simd_kernels.hpp), so the generator holds no state
+// to step and can skip to any position for free. The key is hashed from the
+// master seed and each thread counts along its own stream, so the same master
+// seed always gives the same numbers on each thread.
+
+// Unlike the other generators the bulk fill and get_rand() share one sequence. A
+// fill starts at the next whole block and get_rand() carries on from where it ends.
+
+template<typename state_type>
+class philox
+{
+protected:
+	static constexpr unsigned int STYPE_BITS = 8*sizeof(state_type);
+
+	// Rands in each 128-bit block
+	static constexpr unsigned int per_block = 128 / STYPE_BITS;
+
+	unsigned int thread_no = 0;
+
+	philox_counter counter;
+
+	// The block get_rand() is working through, from buffer[used] on
+	state_type buffer[per_block];
+	unsigned int used = per_block;
+
+	philox() = default;
+
+	// The rands of a block, 64-bit rands are two words with the first in the low half
+	static void block_rands(const philox_counter& c, const std::uint64_t block, state_type (&out)[per_block])
+	{
+		std::uint32_t words[4];
+		philox4x32_10(c, block, words);
+
+		for(unsigned int i = 0; i < per_block; i++)
+		{
+			if constexpr(STYPE_BITS == 64)
+				out[i] = std::uint64_t(words[2*i + 1]) << 32 | words[2*i];
+			else
+				out[i] = words[i];
+		}
+	}
+
+public:
+	philox(const unsigned int thread_id, const std::uint64_t master_seed) : thread_no{thread_id}
+	{
+		std::cout << "Creating Philox generator for thread : " << thread_id << "\n";
+
+		counter = make_counter(master_seed, thread_id);
+	}
+
+	// The key hashed from a seed and the start of a stream
+	static philox_counter make_counter(const std::uint64_t seed, const std::uint64_t stream)
+	{
+		splitmix64<std::uint64_t> seed_gen(seed);
+		const std::uint64_t key = seed_gen();
+
+		return philox_counter{{static_cast<std::uint32_t>(key), static_cast<std::uint32_t>(key >> 32)}, 0, stream};
+	}
+
+	// A generator for any of the 2^64 streams of a seed's key. Used for the
+	// fixed blocks of Threaded_rands' block partitioning
+	static philox substream(const std::uint64_t seed, const std::uint64_t stream)
+	{
+		philox gen;
+		gen.counter = make_counter(seed, stream);
+
+		return gen;
+	}
+
+	// The rand at position index of a stream, worked out directly
+	static state_type stream_at(const std::uint64_t seed, const std::uint64_t stream, const std::uint64_t index)
+	{
+		state_type rands[per_block];
+		block_rands(make_counter(seed, stream), index / per_block, rands);
+
+		return rands[index % per_block];
+	}
+
+	state_type get_rand()
+	{
+		if(used == per_block)
+		{
+			block_rands(counter, counter.block++, buffer);
+			used = 0;
+		}
+
+		return buffer[used++];
+	}
+
+	state_type operator()() { return get_rand(); }
+
+	// The rand at position index of this generator's stream, without moving to it
+	state_type at(const std::uint64_t index) const
+	{
+		state_type rands[per_block];
+		block_rands(counter, index / per_block, rands);
+
+		return rands[index % per_block];
+	}
+
+	// The position in the stream of the rand the next get_rand() gives
+	std::uint64_t position() const { return counter.block * per_block - (per_block - used); }
+
+	// Move to position index, so the next get_rand() gives at(index)
+	void seek(const std::uint64_t index)
+	{
+		counter.block = index / per_block;
+		used = per_block;
+
+		if(index % per_block != 0)
+		{
+			block_rands(counter, counter.block++, buffer);
+			used = index % per_block;
+		}
+	}
+
+	// The next rands of the stream, 8 blocks at a time. Whatever is left of
+	// get_rand()'s block is skipped.
+	template <typename Out>
+	void fill(const Out& out, const std::size_t n)
+	{
+		used = per_block;
+		philox_fill<STYPE_BITS>(counter, out, n);
+	}
+};
+
+// ======================================
+// 			  Threefry4x64
+// ======================================
+
+// Threefry-4x64 from Random123, with 20 rounds or the faster 13. It is used the
+// same way as philox above (a key hashed from the master seed, a stream for each
+// thread, any position reachable directly) but each block is 256 bits made with
+// only adds, rotates and xors, which suits CPUs with slow vector multiplies.
+
+template<typename state_type, unsigned int Rounds = 20>
+class threefry
+{
+protected:
+	static constexpr unsigned int STYPE_BITS = 8*sizeof(state_type);
+
+	// Rands in each 256-bit block
+	static constexpr unsigned int per_block = 256 / STYPE_BITS;
+
+	unsigned int thread_no = 0;
+
+	threefry_counter counter;
+
+	// The block get_rand() is working through, from buffer[used] on
+	state_type buffer[per_block];
+	unsigned int used = per_block;
+
+	threefry() = default;
+
+	// The rands of a block, 32-bit rands take the low half of each word first
+	static void block_rands(const threefry_counter& c, const std::uint64_t block, state_type (&out)[per_block])
+	{
+		std::uint64_t words[4];
+		threefry4x64<Rounds>(c, block, words);
+
+		for(unsigned int i = 0; i < per_block; i++)
+		{
+			if constexpr(STYPE_BITS == 64)
+				out[i] = words[i];
+			else
+				out[i] = static_cast<state_type>(words[i / 2] >> (32 * (i % 2)));
+		}
+	}
+
+public:
+	threefry(const unsigned int thread_id, const std::uint64_t master_seed) : thread_no{thread_id}
+	{
+		std::cout << "Creating Threefry generator for thread : " << thread_id << "\n";
+
+		counter = make_counter(master_seed, thread_id);
+	}
+
+	// The key hashed from a seed and the start of a stream
+	static threefry_counter make_counter(const std::uint64_t seed, const std::uint64_t stream)
+	{
+		splitmix64<std::uint64_t> seed_gen(seed);
+		const std::uint64_t key[4] = {seed_gen(), seed_gen(), seed_gen(), seed_gen()};
+
+		threefry_counter c;
+		threefry_key(c, key);
+		c.block = 0;
+		c.stream = stream;
+
+		return c;
+	}
+
+	// A generator for any of the 2^64 streams of a seed's key. Used for the
+	// fixed blocks of Threaded_rands' block partitioning
+	static threefry substream(const std::uint64_t seed, const std::uint64_t stream)
+	{
+		threefry gen;
+		gen.counter = make_counter(seed, stream);
+
+		return gen;
+	}
+
+	// The rand at position index of a stream, worked out directly
+	static state_type stream_at(const std::uint64_t seed, const std::uint64_t stream, const std::uint64_t index)
+	{
+		state_type rands[per_block];
+		block_rands(make_counter(seed, stream), index / per_block, rands);
+
+		return rands[index % per_block];
+	}
+
+	state_type get_rand()
+	{
+		if(used == per_block)
+		{
+			block_rands(counter, counter.block++, buffer);
+			used = 0;
+		}
+
+		return buffer[used++];
+	}
+
+	state_type operator()() { return get_rand(); }
+
+	// The rand at position index of this generator's stream, without moving to it
+	state_type at(const std::uint64_t index) const
+	{
+		state_type rands[per_block];
+		block_rands(counter, index / per_block, rands);
+
+		return rands[index % per_block];
+	}
+
+	// The position in the stream of the rand the next get_rand() gives
+	std::uint64_t position() const { return counter.block * per_block - (per_block - used); }
+
+	// Move to position index, so the next get_rand() gives at(index)
+	void seek(const std::uint64_t index)
+	{
+		counter.block = index / per_block;
+		used = per_block;
+
+		if(index % per_block != 0)
+		{
+			block_rands(counter, counter.block++, buffer);
+			used = index % per_block;
+		}
+	}
+
+	// Fill n elements of out with the next rands of the stream, 8 blocks at a time.
+	// Whatever is left of get_rand()'s block is skipped.
+	template <typename Out>
+	void fill(const Out& out, const std::size_t n)
+	{
+		used = per_block;
+		threefry_fill<STYPE_BITS, Rounds>(counter, out, n);
+	}
+};
+
+// ======================================
+// 		 xoshiro256++ / xoshiro256**
+// ======================================
+
+// The xoshiro256++ and xoshiro256** PRNGs by David Blackman and Sebastiano Vigna
+// http://xoshiro.di.unimi.it/
+
+// With 256 bits of state the period is 2^256 - 1. jump() moves the stream on by
+// 2^128 draws and long_jump() by 2^192, the same as the reference jump() and
+// long_jump(). Streams can be split up in two levels, long_jump() once for each
+// process and jumps for each thread within it.
+
+// The state is seeded from the master seed. Thread t's stream starts 9t jumps in,
+// the 8 jumps in between are the starts of its SIMD lanes, so every stream has
+// 2^128 draws before it runs into another. With a 32-bit state type get_rand()
+// gives the top half of each 64-bit output.
+
+template<typename state_type, bool StarStar = false>
+class xoshiro256
+{
+protected:
+	static constexpr unsigned int STYPE_BITS = 8*sizeof(state_type);
+
+	// Jumps between the streams of neighbouring threads
+	static constexpr unsigned int thread_jumps = simd::n_lanes + 1;
+
+	unsigned int thread_no = 0;
+
+	std::uint64_t seed_array[4];
+
+	// State for the SIMD bulk fill, only used by the 64-bit generator
+	xoshiro256_lanes lanes;
+
+	xoshiro256() = default;
+
+	// The jump polynomials for 2^128 and 2^192 draws
+	static constexpr std::uint64_t JUMP[4] = {0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c};
+	static constexpr std::uint64_t LONG_JUMP[4] = {0x76e15d3efefdcbbf, 0xc5004e441c522fb3, 0x77710069854ee241, 0x39109bb02acbe635};
+
+	static inline std::uint64_t rotl(const std::uint64_t x, int k) {return (x << k) | (x >> (64 - k));}
+
+	std::uint64_t next()
+	{
+		std::uint64_t result;
+		if constexpr(StarStar)
+			result = rotl(seed_array[1] * 5, 7) * 9;
+		else
+			result = rotl(seed_array[0] + seed_array[3], 23) + seed_array[0];
+
+		const std::uint64_t t = seed_array[1] << 17;
+
+		seed_array[2] ^= seed_array[0];
+		seed_array[3] ^= seed_array[1];
+		seed_array[1] ^= seed_array[2];
+		seed_array[0] ^= seed_array[3];
+
+		seed_array[2] ^= t;
+
+		seed_array[3] = rotl(seed_array[3], 45);
+
+		return result;
+	}
+
+	// Apply a jump polynomial to the state
+	void jump_by(const std::uint64_t (&jump)[4])
+	{
+		std::uint64_t s[4] = {0, 0, 0, 0};
+
+		for(std::size_t i = 0; i < 4; i++)
+		{
+			for(int b = 0; b < 64; b++)
+			{
+				if(jump[i] & UINT64_C(1) << b)
+				{
+					for(std::size_t w = 0; w < 4; w++)
+						s[w] ^= seed_array[w];
+				}
+				next();
+			}
+		}
+
+		for(std::size_t w = 0; w < 4; w++)
+			seed_array[w] = s[w];
+	}
+
+	// Move on from the start of one thread's stream to the next, past the starts
+	// of the first thread's lanes
+	void next_thread_stream()
+	{
+		for(unsigned int j = 0; j < thread_jumps; j++)
+			jump_by(JUMP);
+	}
+
+	// Lane l starts l + 1 jumps on from this generator's own stream
+	void seed_lanes()
+	{
+		if constexpr(STYPE_BITS == 64)
+		{
+			xoshiro256 lane_gen = *this;
+
+			for(std::size_t l = 0; l < simd::n_lanes; l++)
+			{
+				lane_gen.jump_by(JUMP);
+				lanes.s0[l] = lane_gen.seed_array[0];
+				lanes.s1[l] = lane_gen.seed_array[1];
+				lanes.s2[l] = lane_gen.seed_array[2];
+				lanes.s3[l] = lane_gen.seed_array[3];
+			}
+		}
+	}
+
+public:
+	xoshiro256(const unsigned int thread_id, const std::uint64_t master_seed) : thread_no{thread_id}
+	{
+		std::cout << "Creating xoshiro256" << (StarStar ? "**" : "++") << " generator for thread : " << thread_id << "\n";
+
+		// The state mustn't be all zero, four SplitMix64 outputs in a row never are
+		splitmix64<std::uint64_t> seed_gen(master_seed);
+		for(auto& s : seed_array)
+			s = seed_gen();
+
+		for(unsigned int t = 0; t < thread_id; t++)
+			next_thread_stream();
+
+		seed_lanes();
+	}
+
+	// A generator whose state is hashed from a seed and a stream number, with its
+	// lanes jumps apart as above. Used for the fixed blocks of Threaded_rands' block
+	// partitioning, which can't jump each block's stream on from the one before
+	// without the cost growing with the number of blocks. With a period of 2^256 the
+	// odds of two blocks' streams overlapping are negligible
+	static xoshiro256 substream(const std::uint64_t seed, const std::uint64_t stream)
+	{
+		xoshiro256 gen;
+
+		splitmix64<std::uint64_t> stream_hash(stream);
+		splitmix64<std::uint64_t> seed_gen(seed ^ stream_hash());
+		for(auto& s : gen.seed_array)
+			s = seed_gen();
+
+		gen.seed_lanes();
+
+		return gen;
+	}
+
+	// The same as calling get_rand() 2^128 times, the lanes move with the stream.
+	// The stream then starts where lane 0 did and lanes 0 to 6 where lanes 1 to 7
+	// did, Threaded_rands' threads are 9 jumps apart so no two of them overlap
+	void jump()
+	{
+		jump_by(JUMP);
+		seed_lanes();
+	}
+
+	// The same as calling get_rand() 2^192 times, the lanes move with the stream
+	void long_jump()
+	{
+		jump_by(LONG_JUMP);
+		seed_lanes();
+	}
+
+	state_type get_rand() { return static_cast<state_type>(next() >> (64 - STYPE_BITS)); }
+
+	state_type operator()() {return get_rand();}
+
+	// Lane l of the bulk fill starts l + 1 jumps on from this generator's stream,
+	// jump() and long_jump() move the lanes with it
+	template <typename Out, typename T = state_type>
+	typename std::enable_if<8*sizeof(T) == 64, void>::type
+	fill(const Out& out, const std::size_t n) { xoshiro256_fill<StarStar>(lanes, out, n); }
+};
+
+// ======================================
+// 				 SFC64
+// ======================================
+
+// Chris Doty-Humphrey's Small Fast Chaotic PRNG from PractRand, SFC64 or SFC32
+// depending on the state type
+// http://pracrand.sourceforge.net/
+
+// Like JSF it mixes a chaotic state, but a counter is added in at every step so
+// no seed can land on a cycle shorter than 2^64 (2^32 for SFC32) draws. Each
+// thread and each SIMD lane is seeded straight from a hash of the master seed
+// and the thread id, which costs the same however many threads there are.
+
+template<typename state_type>
+class sfc
+{
+protected:
+	static constexpr unsigned int STYPE_BITS = 8*sizeof(state_type);
+
+	// The rotate, right shift and left shift for SFC64 and SFC32
+	static constexpr unsigned int barrel_shift = (STYPE_BITS == 64) ? 24 : 21;
+	static constexpr unsigned int rshift = (STYPE_BITS == 64) ? 11 : 9;
+	static constexpr unsigned int lshift = 3;
+
+	unsigned int thread_no = 0;
+
+	state_type a_, b_, c_, counter_;
+
+	// State for the SIMD bulk fill, only used by the 64-bit generator
+	sfc64_lanes lanes;
+
+	static state_type rotate(state_type x, unsigned int k) { return (x << k) | (x >> (STYPE_BITS - k)); }
+
+	sfc() = default;
+
+	// Hash the stream number before mixing it in so neighbouring streams don't
+	// start at neighbouring points of the same SplitMix64 sequence
+	void seed_stream(const std::uint64_t master_seed, const std::uint64_t stream)
+	{
+		splitmix64<std::uint64_t> stream_hash(stream);
+		splitmix64<std::uint64_t> seed_gen(master_seed ^ stream_hash());
+
+		const std::uint64_t a = seed_gen();
+		const std::uint64_t b = seed_gen();
+		const std::uint64_t c = seed_gen();
+		seed(a, b, c);
+
+		seed_lanes(seed_gen);
+	}
+
+	// The lanes are seeded like generators of their own from the next values
+	// of the SplitMix64 used to seed this generator
+	void seed_lanes(splitmix64<std::uint64_t>& seed_gen)
+	{
+		if constexpr(STYPE_BITS == 64)
+		{
+			for(std::size_t l = 0; l < simd::n_lanes; l++)
+			{
+				lanes.a[l] = seed_gen();
+				lanes.b[l] = seed_gen();
+				lanes.c[l] = seed_gen();
+				lanes.counter[l] = 1;
+			}
+
+			// The same 12 rounds seed() runs
+			std::uint64_t discard[12 * simd::n_lanes];
+			sfc64_fill(lanes, simd::int_out<std::uint64_t>{discard}, 12 * simd::n_lanes);
+		}
+	}
+
+public:
+	sfc(const unsigned int thread_id, const std::uint64_t master_seed) : thread_no{thread_id}
+	{
+		std::cout << "Creating SFC generator for thread : " << thread_id << "\n";
+
+		seed_stream(master_seed, thread_id);
+	}
+
+	// A generator for any stream of a seed, seeded in the same way as the threads'.
+	// Used for the fixed blocks of Threaded_rands' block partitioning
+	static sfc substream(const std::uint64_t seed, const std::uint64_t stream)
+	{
+		sfc gen;
+		gen.seed_stream(seed, stream);
+
+		return gen;
+	}
+
+	void seed(const std::uint64_t a, const std::uint64_t b, const std::uint64_t c)
+	{
+		a_ = static_cast<state_type>(a);
+		b_ = static_cast<state_type>(b);
+		c_ = static_cast<state_type>(c);
+		counter_ = 1;
+
+		for(unsigned int i = 0; i < 12; i++)
+			get_rand();
+	}
+
+	state_type get_rand()
+	{
+		const state_type tmp = a_ + b_ + counter_++;
+		a_ = b_ ^ (b_ >> rshift);
+		b_ = c_ + (c_ << lshift);
+		c_ = rotate(c_, barrel_shift) + tmp;
+
+		return tmp;
+	}
+
+	state_type operator()() { return get_rand(); }
+
+	// The bulk fill's 8 lanes are each seeded like a generator of their own from the
+	// SplitMix64 that seeded this one, the same for substream() as for a thread
+	template <typename Out, typename T = state_type>
+	typename std::enable_if<8*sizeof(T) == 64, void>::type
+	fill(const Out& out, const std::size_t n) { sfc64_fill(lanes, out, n); }
 };
 
+// ======================================
+// 				ChaCha
+// ======================================
+
+// A cryptographically secure generator from the ChaCha stream cipher with 20, 12
+// or 8 rounds, for when the numbers mustn't be predictable by anyone watching
+// the output. Each generator has its own 256-bit key read from std::random_device
+// and is never seeded from the master seed, 64 bits of which would be far too
+// few to keep secret, so its output can't be repeated. The thread id is the stream.
+
+// get_rand() hands out a buffer of keystream made 16 blocks at a time by the SIMD
+// kernel. There is no key erasure, anyone who can read the generator's memory can
+// work out its past and future output.
+
+template<typename state_type, unsigned int Rounds = 20>
+class chacha
+{
+protected:
+	static constexpr unsigned int STYPE_BITS = 8*sizeof(state_type);
+
+	// Rands in the buffer, 16 blocks which is a whole number of steps of the kernel
+	static constexpr unsigned int buffer_size = 16 * 512 / STYPE_BITS;
+
+	unsigned int thread_no = 0;
+
+	chacha_counter counter;
+
+	// Keystream get_rand() is working through, from buffer[used] on
+	state_type buffer[buffer_size];
+	unsigned int used = buffer_size;
+
+	chacha() = default;
+
+public:
+	chacha(const unsigned int thread_id) : thread_no{thread_id}
+	{
+		std::cout << "Creating ChaCha generator for thread : " << thread_id << "\n";
+
+		std::random_device rd;
+		for(unsigned int k = 0; k < 8; k++)
+			counter.key[k] = rd();
+
+		counter.block = 0;
+		counter.stream = thread_id;
+	}
+
+	// A generator with the same key on another stream. Used for the fixed
+	// blocks of Threaded_rands' block partitioning
+	chacha substream(const std::uint64_t stream) const
+	{
+		chacha gen;
+		gen.thread_no = thread_no;
+		gen.counter = counter;
+		gen.counter.block = 0;
+		gen.counter.stream = stream;
+
+		return gen;
+	}
+
+	state_type get_rand()
+	{
+		if(used == buffer_size)
+		{
+			chacha_fill<STYPE_BITS, Rounds>(counter, simd::int_out<state_type>{buffer}, buffer_size);
+			used = 0;
+		}
+
+		return buffer[used++];
+	}
+
+	state_type operator()() { return get_rand(); }
+
+	// Fill n elements of out with the next keystream from the SIMD kernel.
+	// Whatever is left of get_rand()'s buffer is skipped.
+	template <typename Out>
+	void fill(const Out& out, const std::size_t n)
+	{
+		used = buffer_size;
+		chacha_fill<STYPE_BITS, Rounds>(counter, out, n);
+	}
+};
+
+// Generators with a SIMD bulk fill(out, n). This fills n elements of out, one of the
+// output stages in simd_kernels.hpp, with rands as wide as the state type from several
+// copies of the generator (its lanes) stepped together with SIMD instructions. The
+// lanes are separate streams from the one get_rand() draws from, apart from the
+// counter-based generators and ChaCha whose fills carry on along the same stream
+template<typename G, typename = void>
+struct has_bulk_fill : std::false_type {};
+
+template<typename G>
+struct has_bulk_fill<G, std::void_t<decltype(std::declval<G&>().fill(simd::int_out<std::uint64_t>{nullptr}, std::size_t()))>> : std::true_type {};
+
+// Generators whose lowest output bits are weak, the '+' scramblers. Their rands
+// are mixed before being split into narrower ints
+template<typename G>
+struct has_weak_low_bits : std::false_type {};
+
+template<typename state_type, std::size_t S_SIZE>
+struct has_weak_low_bits<xoroshiro128<state_type, S_SIZE>> : std::true_type {};
+
+// The counter-based generators, any rand of their stream can be read with at(index)
+template<typename G, typename = void>
+struct has_random_access : std::false_type {};
+
+template<typename G>
+struct has_random_access<G, std::void_t<decltype(std::declval<const G&>().at(std::uint64_t()))>> : std::true_type {};
+
+// Generators whose streams can be moved on by 2^192 draws, see Threaded_rands::long_jump
+template<typename G, typename = void>
+struct has_long_jump : std::false_type {};
+
+template<typename G>
+struct has_long_jump<G, std::void_t<decltype(std::declval<G&>().long_jump())>> : std::true_type {};
+
+// Check the generators can be copied around as plain bytes, and that a copy gives
+// the same sequence. pcg_unique is left out as its sequence depends on its address
+static_assert(std::is_trivially_copyable<splitmix64<std::uint64_t>>::value, "splitmix64 must be trivially copyable");
+static_assert(std::is_trivially_copyable<xoroshiro128<std::uint64_t>>::value, "xoroshiro128 must be trivially copyable");
+static_assert(std::is_trivially_copyable<xoroshiro128<std::uint32_t>>::value, "xoroshiro128 must be trivially copyable");
+static_assert(std::is_trivially_copyable<pcg_setseq<std::uint64_t>>::value, "pcg_setseq must be trivially copyable");
+static_assert(std::is_trivially_copyable<pcg_setseq<std::uint32_t>>::value, "pcg_setseq must be trivially copyable");
+static_assert(std::is_trivially_copyable<jsf<std::uint64_t>>::value, "jsf must be trivially copyable");
+static_assert(std::is_trivially_copyable<jsf<std::uint32_t>>::value, "jsf must be trivially copyable");
+static_assert(std::is_trivially_copyable<philox<std::uint64_t>>::value, "philox must be trivially copyable");
+static_assert(std::is_trivially_copyable<philox<std::uint32_t>>::value, "philox must be trivially copyable");
+static_assert(std::is_trivially_copyable<threefry<std::uint64_t>>::value, "threefry must be trivially copyable");
+static_assert(std::is_trivially_copyable<threefry<std::uint32_t, 13>>::value, "threefry must be trivially copyable");
+static_assert(std::is_trivially_copyable<xoshiro256<std::uint64_t>>::value, "xoshiro256 must be trivially copyable");
+static_assert(std::is_trivially_copyable<xoshiro256<std::uint32_t, true>>::value, "xoshiro256 must be trivially copyable");
+static_assert(std::is_trivially_copyable<sfc<std::uint64_t>>::value, "sfc must be trivially copyable");
+static_assert(std::is_trivially_copyable<sfc<std::uint32_t>>::value, "sfc must be trivially copyable");
+static_assert(std::is_trivially_copyable<chacha<std::uint64_t>>::value, "chacha must be trivially copyable");
+static_assert(std::is_trivially_copyable<chacha<std::uint32_t, 8>>::value, "chacha must be trivially copyable");
+
 #endif
\ No newline at end of file
@@ -0,0 +1,1752 @@
+#ifndef SIMD_KERNELS_HPP
+#define SIMD_KERNELS_HPP
+
+#include <cstddef>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include "cpu_features.hpp"
+
+#if defined(THREADED_RANDS_X86_SIMD)
+#include <immintrin.h>
+#endif
+
+// ======================================
+// 			  SIMD kernels
+// ======================================
+
+// Bulk fills that step several copies of a generator at once, one copy in each
+// lane of a vector, and write whole vectors of output straight to the buffer.
+
+// Each kernel body is written once with GCC vector extensions and inlined into a
+// thin wrapper for each instruction set (see cpu_features.hpp), the compiler then
+// lowers the vector operations to SSE2, SSE4.2, AVX2 or AVX-512 instructions.
+// Every version steps the same 8 lanes in the same order so the output doesn't
+// depend on the CPU, AVX2 just holds the 8 lanes in two registers.
+
+// The lanes are interleaved in the output, element i comes from lane i % 8
+// (i % 16 for PCG32). A fill that isn't a multiple of the number of lanes long
+// still steps every lane and the left over values are dropped.
+
+// What is written is decided by an output stage passed to the kernel, which
+// takes each vector of raw rands and converts and stores it, so a conversion
+// is fused into the generator loop rather than run over an integer buffer.
+
+// Vectors are only ever passed to the helpers by reference and never returned.
+// Passing 512-bit vectors by value from code built without AVX-512 changes
+// the ABI and GCC warns about it even when the call is inlined.
+#define THREADED_RANDS_INLINE inline __attribute__((always_inline))
+
+namespace simd
+{
+	constexpr std::size_t n_lanes = 8;
+
+	typedef std::uint64_t u64x8 __attribute__((vector_size(64)));
+	typedef std::uint32_t u32x16 __attribute__((vector_size(64)));
+	typedef double f64x8 __attribute__((vector_size(64)));
+	typedef std::int32_t i32x16 __attribute__((vector_size(64)));
+	typedef float f32x16 __attribute__((vector_size(64)));
+
+	// Unaligned loads and stores
+	THREADED_RANDS_INLINE void load(u64x8& v, const std::uint64_t* p) { std::memcpy(&v, p, sizeof(v)); }
+
+	THREADED_RANDS_INLINE void store(std::uint64_t* p, const u64x8& v) { std::memcpy(p, &v, sizeof(v)); }
+
+	// A store that doesn't read the cache line in first or keep it in the cache,
+	// for buffers too big to stay there anyway. The stores are 128 bits wide so
+	// they are there on every x86-64 CPU, p must be 16-byte aligned. stream_fence()
+	// has to be called before anything else relies on seeing the data.
+	template<typename V>
+	THREADED_RANDS_INLINE void stream_store(unsigned char* p, const V& v)
+	{
+	#if defined(THREADED_RANDS_X86_SIMD)
+		__m128i parts[sizeof(V) / sizeof(__m128i)];
+		std::memcpy(parts, &v, sizeof(v));
+		for(std::size_t k = 0; k < sizeof(V) / sizeof(__m128i); k++)
+			_mm_stream_si128(reinterpret_cast<__m128i*>(p) + k, parts[k]);
+	#else
+		std::memcpy(p, &v, sizeof(v));
+	#endif
+	}
+
+	inline void stream_fence()
+	{
+	#if defined(THREADED_RANDS_X86_SIMD)
+		_mm_sfence();
+	#endif
+	}
+
+	// The low 32 bits of each element of lo followed by those of hi
+	THREADED_RANDS_INLINE void narrow(u32x16& result, const u64x8& lo, const u64x8& hi)
+	{
+		const u32x16 evens = {0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30};
+		result = __builtin_shuffle((u32x16)lo, (u32x16)hi, evens);
+	}
+
+	// (x >> shift) * scale, exactly as the scalar conversion does it for any
+	// x >> shift below 2^53. There's no 64-bit int to double conversion before
+	// AVX-512 so each half of the value is put in the mantissa of 2^52, which
+	// is then subtracted off, and the halves are put back together.
+	THREADED_RANDS_INLINE void to_double(f64x8& result, const u64x8& x, const unsigned int shift, const double scale)
+	{
+		const u64x8 v = x >> shift;
+
+		const u64x8 hi_bits = (v >> 26) | 0x4330000000000000;
+		const u64x8 lo_bits = (v & 0x3ffffff) | 0x4330000000000000;
+
+		const f64x8 hi = (f64x8)hi_bits - 0x1p52;
+		const f64x8 lo = (f64x8)lo_bits - 0x1p52;
+
+		result = (hi * 0x1p26 + lo) * scale;
+	}
+
+	// The top 24 bits of each word as a float [0:1). A float has a 24-bit mantissa
+	// so k * 2^-24 is exact and every value is equally likely.
+	THREADED_RANDS_INLINE void to_float(f32x16& result, const u32x16& w)
+	{
+		result = __builtin_convertvector((i32x16)(w >> 8), f32x16) * 0x1p-24f;
+	}
+
+	THREADED_RANDS_INLINE float to_float(const std::uint32_t w)
+	{
+		return static_cast<float>(static_cast<std::int32_t>(w >> 8)) * 0x1p-24f;
+	}
+
+	// Floats [lower:upper) as lower + k * scale for the top 24 bits k of each word.
+	// The sum is done in double and rounded once to a float. scale is a float
+	// times 2^-24 so k * scale is exact in a double, which gives the same result
+	// whether or not the compiler fuses the multiply and add for a target with FMA.
+	struct float_range
+	{
+		double lower;
+		double scale;
+		float upper;
+		// The largest float below upper, for sums that round up to upper
+		float below_upper;
+
+		float_range(const float lower_, const float upper_)
+			: lower{lower_}, scale{span_scale(double(upper_) - double(lower_))}, 
+			  upper{upper_}, below_upper{std::nextafter(upper_, lower_)} {}
+
+		// The span rounded to a float's precision, times 2^-24. A span wider than
+		// the largest float (up to twice it for [-FLT_MAX:FLT_MAX)) would overflow
+		// the cast, so it is scaled down first, which rounds it the same way
+		static double span_scale(const double span)
+		{
+			if(span <= std::numeric_limits<float>::max())
+				return static_cast<float>(span) * 0x1p-24;
+
+			return static_cast<float>(span * 0x1p-24);
+		}
+
+		THREADED_RANDS_INLINE void operator()(f32x16& result, const u32x16& w) const
+		{
+			typedef std::int32_t i32x8 __attribute__((vector_size(32)));
+			typedef float f32x8 __attribute__((vector_size(32)));
+
+			const i32x16 k = (i32x16)(w >> 8);
+
+			// The halves are converted separately as 16 doubles take two vectors
+			i32x8 k_half;
+			f32x8 f_half;
+			for(std::size_t h = 0; h < 2; h++)
+			{
+				std::memcpy(&k_half, reinterpret_cast<const char*>(&k) + h * sizeof(k_half), sizeof(k_half));
+
+				const f64x8 d = __builtin_convertvector(k_half, f64x8) * scale + lower;
+
+				f_half = __builtin_convertvector(d, f32x8);
+				f_half = (f_half < upper) ? f_half : below_upper;
+
+				std::memcpy(reinterpret_cast<char*>(&result) + h * sizeof(f_half), &f_half, sizeof(f_half));
+			}
+		}
+
+		THREADED_RANDS_INLINE float operator()(const std::uint32_t w) const
+		{
+			const float f = static_cast<float>(static_cast<std::int32_t>(w >> 8) * scale + lower);
+
+			return (f < upper) ? f : below_upper;
+		}
+	};
+
+	// Floats [0:1) through to_float
+	struct unit_float
+	{
+		THREADED_RANDS_INLINE void operator()(f32x16& result, const u32x16& w) const { to_float(result, w); }
+
+		THREADED_RANDS_INLINE float operator()(const std::uint32_t w) const { return to_float(w); }
+	};
+
+	// Spread the upper half of each rand over the weak low bits of the '+'
+	// scramblers (xoroshiro128+), whose lowest bits are close to linear, before
+	// it is split into narrower ints. The xorshift puts the upper half into the
+	// lower and the odd multiply then carries the lower half into the upper, so
+	// no piece of the result is a simple function of the weak bits. Both steps
+	// are invertible so every value is still equally likely.
+	THREADED_RANDS_INLINE void mix_low_bits(u64x8& x)
+	{
+		x ^= x >> 32;
+		x *= 0x9e3779b97f4a7c15;
+	}
+
+	THREADED_RANDS_INLINE void mix_low_bits(u32x16& x)
+	{
+		x ^= x >> 16;
+		x *= 0x9e3779b9;
+	}
+
+	THREADED_RANDS_INLINE std::uint64_t mix_low_bits(std::uint64_t x)
+	{
+		x ^= x >> 32;
+		return x * 0x9e3779b97f4a7c15;
+	}
+
+	THREADED_RANDS_INLINE std::uint32_t mix_low_bits(std::uint32_t x)
+	{
+		x ^= x >> 16;
+		return x * 0x9e3779b9;
+	}
+
+	// ======================================
+	// 			  Output stages
+	// ======================================
+
+	// Each stage has put(i, v), which writes the 8 values of v to elements
+	// [i:i+8) of the output, and put_partial(i, v, n) which only writes the first n.
+	// put_pair(i, lo, hi) writes 16 values, lo then hi.
+
+	// Store the rands as they are, or just their low 32 bits for a 32-bit T
+	template<typename T>
+	struct int_out
+	{
+		T* out;
+
+		THREADED_RANDS_INLINE void put(const std::size_t i, const u64x8& v) const
+		{
+			put_partial(i, v, n_lanes);
+		}
+
+		THREADED_RANDS_INLINE void put_partial(const std::size_t i, const u64x8& v, const std::size_t n) const
+		{
+			if constexpr(sizeof(T) == sizeof(std::uint64_t))
+			{
+				std::memcpy(out + i, &v, n * sizeof(T));
+			}
+			else
+			{
+				u32x16 narrowed;
+				narrow(narrowed, v, v);
+				std::memcpy(out + i, &narrowed, n * sizeof(T));
+			}
+		}
+
+		THREADED_RANDS_INLINE void put_pair(const std::size_t i, const u64x8& lo, const u64x8& hi) const
+		{
+			if constexpr(sizeof(T) == sizeof(std::uint64_t))
+			{
+				put(i, lo);
+				put(i + n_lanes, hi);
+			}
+			else
+			{
+				u32x16 narrowed;
+				narrow(narrowed, lo, hi);
+				std::memcpy(out + i, &narrowed, sizeof(narrowed));
+			}
+		}
+	};
+
+	// Convert the rands to doubles (x >> shift) * scale
+	struct double_out
+	{
+		double* out;
+		unsigned int shift;
+		double scale;
+
+		THREADED_RANDS_INLINE void put(const std::size_t i, const u64x8& v) const
+		{
+			put_partial(i, v, n_lanes);
+		}
+
+		THREADED_RANDS_INLINE void put_partial(const std::size_t i, const u64x8& v, const std::size_t n) const
+		{
+			f64x8 d;
+			to_double(d, v, shift, scale);
+			std::memcpy(out + i, &d, n * sizeof(double));
+		}
+
+		THREADED_RANDS_INLINE void put_pair(const std::size_t i, const u64x8& lo, const u64x8& hi) const
+		{
+			put(i, lo);
+			put(i + n_lanes, hi);
+		}
+	};
+
+	// Convert the rands to floats with Convert, which turns each 32-bit word into
+	// one float (unit_float or float_range). A 64-bit S gives two floats per rand,
+	// from its low and then its high 32 bits, so element i of the kernel writes
+	// floats [2i:2i+2). A 32-bit S gives one float per rand. With Mix the rands go
+	// through mix_low_bits first, as for bytes_out.
+	template<typename S, typename Convert, bool Mix = false>
+	struct float_out
+	{
+		float* out;
+		Convert convert;
+
+		static constexpr std::size_t per_rand = sizeof(S) / sizeof(std::uint32_t);
+
+		THREADED_RANDS_INLINE void put(const std::size_t i, const u64x8& v) const
+		{
+			put_partial(i, v, n_lanes);
+		}
+
+		THREADED_RANDS_INLINE void put_partial(const std::size_t i, const u64x8& v, const std::size_t n) const
+		{
+			f32x16 f;
+			if constexpr(per_rand == 2)
+			{
+				u64x8 x = v;
+				if constexpr(Mix)
+					mix_low_bits(x);
+				// The words of each lane are already in order in memory
+				const u32x16 words = (u32x16)x;
+				convert(f, words);
+			}
+			else
+			{
+				u32x16 narrowed;
+				narrow(narrowed, v, v);
+				if constexpr(Mix)
+					mix_low_bits(narrowed);
+				convert(f, narrowed);
+			}
+			std::memcpy(out + per_rand * i, &f, per_rand * n * sizeof(float));
+		}
+
+		THREADED_RANDS_INLINE void put_pair(const std::size_t i, const u64x8& lo, const u64x8& hi) const
+		{
+			if constexpr(per_rand == 2)
+			{
+				put(i, lo);
+				put(i + n_lanes, hi);
+			}
+			else
+			{
+				u32x16 narrowed;
+				f32x16 f;
+				narrow(narrowed, lo, hi);
+				if constexpr(Mix)
+					mix_low_bits(narrowed);
+				convert(f, narrowed);
+				std::memcpy(out + i, &f, sizeof(f));
+			}
+		}
+	};
+
+	// Store the bytes of each rand as they are, so element i of the kernel writes
+	// bytes [i*sizeof(S):(i+1)*sizeof(S)). Used to split rands into narrower ints,
+	// with Mix the rands go through mix_low_bits first. With Stream whole vectors
+	// are written with streaming stores, out must then be 16-byte aligned.
+	template<typename S, bool Mix, bool Stream = false>
+	struct bytes_out
+	{
+		unsigned char* out;
+
+		template<typename V>
+		THREADED_RANDS_INLINE void write(const std::size_t offset, const V& v, const std::size_t n_bytes) const
+		{
+			if constexpr(Stream)
+			{
+				if(n_bytes == sizeof(V))
+				{
+					stream_store(out + offset, v);
+					return;
+				}
+			}
+
+			std::memcpy(out + offset, &v, n_bytes);
+		}
+
+		THREADED_RANDS_INLINE void put(const std::size_t i, const u64x8& v) const
+		{
+			put_partial(i, v, n_lanes);
+		}
+
+		THREADED_RANDS_INLINE void put_partial(const std::size_t i, const u64x8& v, const std::size_t n) const
+		{
+			if constexpr(sizeof(S) == sizeof(std::uint64_t))
+			{
+				u64x8 x = v;
+				if constexpr(Mix)
+					mix_low_bits(x);
+				write(i * sizeof(S), x, n * sizeof(S));
+			}
+			else
+			{
+				u32x16 narrowed;
+				narrow(narrowed, v, v);
+				if constexpr(Mix)
+					mix_low_bits(narrowed);
+				write(i * sizeof(S), narrowed, n * sizeof(S));
+			}
+		}
+
+		THREADED_RANDS_INLINE void put_pair(const std::size_t i, const u64x8& lo, const u64x8& hi) const
+		{
+			if constexpr(sizeof(S) == sizeof(std::uint64_t))
+			{
+				put(i, lo);
+				put(i + n_lanes, hi);
+			}
+			else
+			{
+				u32x16 narrowed;
+				narrow(narrowed, lo, hi);
+				if constexpr(Mix)
+					mix_low_bits(narrowed);
+				write(i * sizeof(S), narrowed, sizeof(narrowed));
+			}
+		}
+	};
+
+	// Write n values from a kernel that gives 16 per step, lo then hi
+	template<typename Out>
+	THREADED_RANDS_INLINE void put_pair_partial(const Out& out, const std::size_t i, const u64x8& lo, const u64x8& hi, const std::size_t n)
+	{
+		if(n <= n_lanes)
+		{
+			out.put_partial(i, lo, n);
+		}
+		else
+		{
+			out.put(i, lo);
+			out.put_partial(i + n_lanes, hi, n - n_lanes);
+		}
+	}
+
+	// ======================================
+	// 			  Kernel dispatch
+	// ======================================
+
+	// A kernel is a struct with a static run(lanes, out, n), always inlined into
+	// one of these wrappers, each of which is built for its own instruction set
+	template<typename Kernel, typename Lanes, typename Out>
+	inline void run_generic(Lanes& lanes, const Out& out, const std::size_t n) { Kernel::run(lanes, out, n); }
+
+	template<typename Kernel, typename Lanes, typename Out>
+	THREADED_RANDS_TARGET_SSE42
+	inline void run_sse42(Lanes& lanes, const Out& out, const std::size_t n) { Kernel::run(lanes, out, n); }
+
+	template<typename Kernel, typename Lanes, typename Out>
+	THREADED_RANDS_TARGET_AVX2
+	inline void run_avx2(Lanes& lanes, const Out& out, const std::size_t n) { Kernel::run(lanes, out, n); }
+
+	template<typename Kernel, typename Lanes, typename Out>
+	THREADED_RANDS_TARGET_AVX512
+	inline void run_avx512(Lanes& lanes, const Out& out, const std::size_t n) { Kernel::run(lanes, out, n); }
+
+	// Run a kernel through a function pointer bound to the version for the
+	// active simd_level, the first call for each kernel and output stage binds it
+	template<typename Kernel, typename Lanes, typename Out>
+	inline void run_kernel(Lanes& lanes, const Out& out, const std::size_t n)
+	{
+		using kernel_fn = void (*)(Lanes&, const Out&, std::size_t);
+
+		static const kernel_fn fn = select_kernel<kernel_fn>(&run_generic<Kernel, Lanes, Out>, &run_sse42<Kernel, Lanes, Out>,
+															 &run_avx2<Kernel, Lanes, Out>, &run_avx512<Kernel, Lanes, Out>);
+
+		fn(lanes, out, n);
+	}
+}
+
+// ======================================
+// 		 	xoroshiro128+ lanes
+// ======================================
+
+// The state of 8 xoroshiro128+ generators, kept as one array per state word
+struct xoro128_lanes
+{
+	std::uint64_t s0[simd::n_lanes];
+	std::uint64_t s1[simd::n_lanes];
+};
+
+namespace simd
+{
+	// Rotates are written out in full, the compiler turns them into a single
+	// instruction where there is one
+	THREADED_RANDS_INLINE void xoro128_step(u64x8& s0, u64x8& s1, u64x8& result)
+	{
+		result = s0 + s1;
+
+		s1 ^= s0;
+		s0 = (s0 << 24 | s0 >> 40) ^ s1 ^ (s1 << 16);
+		s1 = s1 << 37 | s1 >> 27;
+	}
+
+	// A fill of n elements as a kernel for run_kernel
+	struct xoro128_kernel
+	{
+		template<typename Out>
+		THREADED_RANDS_INLINE static void run(xoro128_lanes& lanes, const Out& out, const std::size_t n)
+		{
+			u64x8 s0, s1, result;
+			load(s0, lanes.s0);
+			load(s1, lanes.s1);
+
+			std::size_t i = 0;
+			for(; i + n_lanes <= n; i += n_lanes)
+			{
+				xoro128_step(s0, s1, result);
+				out.put(i, result);
+			}
+
+			if(i < n)
+			{
+				xoro128_step(s0, s1, result);
+				out.put_partial(i, result, n - i);
+			}
+
+			store(lanes.s0, s0);
+			store(lanes.s1, s1);
+		}
+	};
+}
+
+// Fill n elements of out from the 8 lanes using the best instruction set available
+template<typename Out>
+inline void xoro128_fill(xoro128_lanes& lanes, const Out& out, const std::size_t n)
+{
+	simd::run_kernel<simd::xoro128_kernel>(lanes, out, n);
+}
+
+// ======================================
+// 		 		JSF64 lanes
+// ======================================
+
+// The state of 8 JSF64 generators, kept as one array per state word
+struct jsf_lanes
+{
+	std::uint64_t a[simd::n_lanes];
+	std::uint64_t b[simd::n_lanes];
+	std::uint64_t c[simd::n_lanes];
+	std::uint64_t d[simd::n_lanes];
+};
+
+namespace simd
+{
+	// jsf::advance with the 64-bit constants 7, 13 and 37
+	THREADED_RANDS_INLINE void jsf_step(u64x8& a, u64x8& b, u64x8& c, u64x8& d)
+	{
+		const u64x8 e = a - (b << 7 | b >> 57);
+		a = b ^ (c << 13 | c >> 51);
+		b = c + (d << 37 | d >> 27);
+		c = d + e;
+		d = e + a;
+	}
+
+	struct jsf_kernel
+	{
+		template<typename Out>
+		THREADED_RANDS_INLINE static void run(jsf_lanes& lanes, const Out& out, const std::size_t n)
+		{
+			u64x8 a, b, c, d;
+			load(a, lanes.a);
+			load(b, lanes.b);
+			load(c, lanes.c);
+			load(d, lanes.d);
+
+			std::size_t i = 0;
+			for(; i + n_lanes <= n; i += n_lanes)
+			{
+				jsf_step(a, b, c, d);
+				out.put(i, d);
+			}
+
+			if(i < n)
+			{
+				jsf_step(a, b, c, d);
+				out.put_partial(i, d, n - i);
+			}
+
+			store(lanes.a, a);
+			store(lanes.b, b);
+			store(lanes.c, c);
+			store(lanes.d, d);
+		}
+	};
+}
+
+// Fill n elements of out from the 8 lanes using the best instruction set available
+template<typename Out>
+inline void jsf_fill(jsf_lanes& lanes, const Out& out, const std::size_t n)
+{
+	simd::run_kernel<simd::jsf_kernel>(lanes, out, n);
+}
+
+// ======================================
+// 		 		PCG32 lanes
+// ======================================
+
+// The state of 16 pcg32 (XSH RR 64/32) generators each on its own stream. The
+// 64-bit multiply has a long latency so two vectors of lanes are stepped at
+// once, which also gives a full 512-bit vector of 32-bit output per step.
+struct pcg32_lanes
+{
+	static constexpr std::size_t n_lanes = 2 * simd::n_lanes;
+
+	std::uint64_t state[n_lanes];
+	// Stream increments, always odd
+	std::uint64_t inc[n_lanes];
+
+	// Seed each lane from next(), which returns 64-bit seeds
+	template<typename F>
+	void seed(F&& next)
+	{
+		for(std::size_t l = 0; l < n_lanes; l++)
+		{
+			state[l] = next();
+			inc[l] = next() | 1;
+		}
+	}
+};
+
+namespace simd
+{
+	// Advance the LCG and return the XSH RR output of the old state in the low
+	// half of each element. The multiply is a single vpmullq with AVX-512, the
+	// compiler builds it from 32-bit multiplies (vpmuludq) on AVX2 and SSE2.
+	THREADED_RANDS_INLINE void pcg32_step(u64x8& state, const u64x8& inc, u64x8& result)
+	{
+		const u64x8 old = state;
+		state = old * 6364136223846793005ULL + inc;
+
+		const u64x8 xorshifted = (((old >> 18) ^ old) >> 27) & 0xffffffff;
+		const u64x8 rot = old >> 59;
+
+		result = (xorshifted >> rot | xorshifted << ((32 - rot) & 31)) & 0xffffffff;
+	}
+
+	struct pcg32_kernel
+	{
+		template<typename Out>
+		THREADED_RANDS_INLINE static void run(pcg32_lanes& lanes, const Out& out, const std::size_t n)
+		{
+			u64x8 state_lo, state_hi, inc_lo, inc_hi, result_lo, result_hi;
+			load(state_lo, lanes.state);
+			load(state_hi, lanes.state + n_lanes);
+			load(inc_lo, lanes.inc);
+			load(inc_hi, lanes.inc + n_lanes);
+
+			std::size_t i = 0;
+			for(; i + pcg32_lanes::n_lanes <= n; i += pcg32_lanes::n_lanes)
+			{
+				pcg32_step(state_lo, inc_lo, result_lo);
+				pcg32_step(state_hi, inc_hi, result_hi);
+				out.put_pair(i, result_lo, result_hi);
+			}
+
+			if(i < n)
+			{
+				pcg32_step(state_lo, inc_lo, result_lo);
+				pcg32_step(state_hi, inc_hi, result_hi);
+				put_pair_partial(out, i, result_lo, result_hi, n - i);
+			}
+
+			store(lanes.state, state_lo);
+			store(lanes.state + n_lanes, state_hi);
+		}
+	};
+}
+
+// Fill n elements of out from the 16 lanes using the best instruction set available
+template<typename Out>
+inline void pcg32_fill(pcg32_lanes& lanes, const Out& out, const std::size_t n)
+{
+	simd::run_kernel<simd::pcg32_kernel>(lanes, out, n);
+}
+
+// ======================================
+// 		 	xoshiro256 lanes
+// ======================================
+
+// The state of 8 xoshiro256++ or xoshiro256** generators, kept as one array per state word
+struct xoshiro256_lanes
+{
+	std::uint64_t s0[simd::n_lanes];
+	std::uint64_t s1[simd::n_lanes];
+	std::uint64_t s2[simd::n_lanes];
+	std::uint64_t s3[simd::n_lanes];
+};
+
+namespace simd
+{
+	// The ++ or ** scrambled output of the current state, then the state is advanced.
+	// The multiplies by 5 and 9 of ** are a shift and an add, which avoids the
+	// 64-bit vector multiply below AVX-512
+	template<bool StarStar>
+	THREADED_RANDS_INLINE void xoshiro256_step(u64x8& s0, u64x8& s1, u64x8& s2, u64x8& s3, u64x8& result)
+	{
+		if constexpr(StarStar)
+		{
+			const u64x8 times5 = s1 + (s1 << 2);
+			const u64x8 rotated = times5 << 7 | times5 >> 57;
+			result = rotated + (rotated << 3);
+		}
+		else
+		{
+			const u64x8 sum = s0 + s3;
+			result = (sum << 23 | sum >> 41) + s0;
+		}
+
+		const u64x8 t = s1 << 17;
+
+		s2 ^= s0;
+		s3 ^= s1;
+		s1 ^= s2;
+		s0 ^= s3;
+
+		s2 ^= t;
+		s3 = s3 << 45 | s3 >> 19;
+	}
+
+	template<bool StarStar>
+	struct xoshiro256_kernel
+	{
+		template<typename Out>
+		THREADED_RANDS_INLINE static void run(xoshiro256_lanes& lanes, const Out& out, const std::size_t n)
+		{
+			u64x8 s0, s1, s2, s3, result;
+			load(s0, lanes.s0);
+			load(s1, lanes.s1);
+			load(s2, lanes.s2);
+			load(s3, lanes.s3);
+
+			std::size_t i = 0;
+			for(; i + n_lanes <= n; i += n_lanes)
+			{
+				xoshiro256_step<StarStar>(s0, s1, s2, s3, result);
+				out.put(i, result);
+			}
+
+			if(i < n)
+			{
+				xoshiro256_step<StarStar>(s0, s1, s2, s3, result);
+				out.put_partial(i, result, n - i);
+			}
+
+			store(lanes.s0, s0);
+			store(lanes.s1, s1);
+			store(lanes.s2, s2);
+			store(lanes.s3, s3);
+		}
+	};
+}
+
+// Fill n elements of out from the 8 lanes using the best instruction set available
+template<bool StarStar, typename Out>
+inline void xoshiro256_fill(xoshiro256_lanes& lanes, const Out& out, const std::size_t n)
+{
+	simd::run_kernel<simd::xoshiro256_kernel<StarStar>>(lanes, out, n);
+}
+
+// ======================================
+// 		 		SFC64 lanes
+// ======================================
+
+// The state of 8 SFC64 generators, kept as one array per state word
+struct sfc64_lanes
+{
+	std::uint64_t a[simd::n_lanes];
+	std::uint64_t b[simd::n_lanes];
+	std::uint64_t c[simd::n_lanes];
+	std::uint64_t counter[simd::n_lanes];
+};
+
+namespace simd
+{
+	// sfc::get_rand with the 64-bit constants 24, 11 and 3
+	THREADED_RANDS_INLINE void sfc64_step(u64x8& a, u64x8& b, u64x8& c, u64x8& counter, u64x8& result)
+	{
+		result = a + b + counter;
+		counter += 1;
+		a = b ^ (b >> 11);
+		b = c + (c << 3);
+		c = (c << 24 | c >> 40) + result;
+	}
+
+	struct sfc64_kernel
+	{
+		template<typename Out>
+		THREADED_RANDS_INLINE static void run(sfc64_lanes& lanes, const Out& out, const std::size_t n)
+		{
+			u64x8 a, b, c, counter, result;
+			load(a, lanes.a);
+			load(b, lanes.b);
+			load(c, lanes.c);
+			load(counter, lanes.counter);
+
+			std::size_t i = 0;
+			for(; i + n_lanes <= n; i += n_lanes)
+			{
+				sfc64_step(a, b, c, counter, result);
+				out.put(i, result);
+			}
+
+			if(i < n)
+			{
+				sfc64_step(a, b, c, counter, result);
+				out.put_partial(i, result, n - i);
+			}
+
+			store(lanes.a, a);
+			store(lanes.b, b);
+			store(lanes.c, c);
+			store(lanes.counter, counter);
+		}
+	};
+}
+
+// Fill n elements of out from the 8 lanes using the best instruction set available
+template<typename Out>
+inline void sfc64_fill(sfc64_lanes& lanes, const Out& out, const std::size_t n)
+{
+	simd::run_kernel<simd::sfc64_kernel>(lanes, out, n);
+}
+
+// ======================================
+// 		 	  Philox4x32-10
+// ======================================
+
+// The counter-based generator of Salmon, Moraes, Dror and Shaw, "Parallel random
+// numbers: as easy as 1, 2, 3" (SC11). Each block of 4 32-bit words is ten rounds
+// of a keyed bijection applied to a 128-bit counter, so there is no state to step
+// and any block can be worked out directly from its number.
+
+// The counter is the block number in its low 64 bits and a stream in its high 64
+struct philox_counter
+{
+	std::uint32_t key[2];
+	// The next block to generate
+	std::uint64_t block;
+	std::uint64_t stream;
+};
+
+namespace simd
+{
+	constexpr std::uint32_t philox_m0 = 0xd2511f53;
+	constexpr std::uint32_t philox_m1 = 0xcd9e8d57;
+	// The key is bumped by these (the golden ratio and sqrt(3) - 1) after each round
+	constexpr std::uint32_t philox_w0 = 0x9e3779b9;
+	constexpr std::uint32_t philox_w1 = 0xbb67ae85;
+}
+
+// The 4 words of a block
+inline void philox4x32_10(const philox_counter& counter, const std::uint64_t block, std::uint32_t (&out)[4])
+{
+	std::uint32_t x0 = static_cast<std::uint32_t>(block);
+	std::uint32_t x1 = static_cast<std::uint32_t>(block >> 32);
+	std::uint32_t x2 = static_cast<std::uint32_t>(counter.stream);
+	std::uint32_t x3 = static_cast<std::uint32_t>(counter.stream >> 32);
+
+	std::uint32_t k0 = counter.key[0];
+	std::uint32_t k1 = counter.key[1];
+
+	for(unsigned int round = 0; round < 10; round++)
+	{
+		const std::uint64_t p0 = std::uint64_t(simd::philox_m0) * x0;
+		const std::uint64_t p1 = std::uint64_t(simd::philox_m1) * x2;
+
+		x0 = static_cast<std::uint32_t>(p1 >> 32) ^ x1 ^ k0;
+		x1 = static_cast<std::uint32_t>(p1);
+		x2 = static_cast<std::uint32_t>(p0 >> 32) ^ x3 ^ k1;
+		x3 = static_cast<std::uint32_t>(p0);
+
+		k0 += simd::philox_w0;
+		k1 += simd::philox_w1;
+	}
+
+	out[0] = x0;
+	out[1] = x1;
+	out[2] = x2;
+	out[3] = x3;
+}
+
+namespace simd
+{
+	// The 64-bit products of the low half of each element of x with m. To GCC's
+	// vector extensions these are full 64-bit multiplies, which it builds out of
+	// three pmuludq and some shifts below AVX-512 and a vpmullq with it, so each
+	// instruction set gets its own version using the one widening multiply.
+	// These aren't always_inline as the intrinsics can only be inlined into code
+	// built for their instruction set, which the kernel is once inlined into its
+	// wrapper. The generic version is for CPUs that aren't x86.
+	struct mul_wide_generic
+	{
+		THREADED_RANDS_INLINE static void apply(u64x8& result, const u64x8& x, const std::uint32_t m)
+		{
+			result = (x & 0xffffffff) * m;
+		}
+	};
+
+#if defined(THREADED_RANDS_X86_SIMD)
+	struct mul_wide_sse2
+	{
+		static inline void apply(u64x8& result, const u64x8& x, const std::uint32_t m)
+		{
+			__m128i parts[4];
+			std::memcpy(parts, &x, sizeof(x));
+
+			const __m128i multiplier = _mm_set1_epi64x(m);
+			parts[0] = _mm_mul_epu32(parts[0], multiplier);
+			parts[1] = _mm_mul_epu32(parts[1], multiplier);
+			parts[2] = _mm_mul_epu32(parts[2], multiplier);
+			parts[3] = _mm_mul_epu32(parts[3], multiplier);
+
+			std::memcpy(&result, parts, sizeof(result));
+		}
+	};
+
+	struct mul_wide_avx2
+	{
+		THREADED_RANDS_TARGET_AVX2
+		static inline void apply(u64x8& result, const u64x8& x, const std::uint32_t m)
+		{
+			__m256i parts[2];
+			std::memcpy(parts, &x, sizeof(x));
+
+			const __m256i multiplier = _mm256_set1_epi64x(m);
+			parts[0] = _mm256_mul_epu32(parts[0], multiplier);
+			parts[1] = _mm256_mul_epu32(parts[1], multiplier);
+
+			std::memcpy(&result, parts, sizeof(result));
+		}
+	};
+
+	struct mul_wide_avx512
+	{
+		THREADED_RANDS_TARGET_AVX512
+		static inline void apply(u64x8& result, const u64x8& x, const std::uint32_t m)
+		{
+			__m512i part;
+			std::memcpy(&part, &x, sizeof(x));
+
+			// The zero-masked form with every lane kept, the plain one leaves GCC 12
+			// warning that its undefined pass-through vector is uninitialised
+			part = _mm512_maskz_mul_epu32(0xff, part, _mm512_set1_epi64(m));
+
+			std::memcpy(&result, &part, sizeof(result));
+		}
+	};
+#else
+	using mul_wide_sse2 = mul_wide_generic;
+	using mul_wide_avx2 = mul_wide_generic;
+	using mul_wide_avx512 = mul_wide_generic;
+#endif
+
+	// 8 consecutive blocks, one in each lane, from the counter's next block. Each
+	// element of lo and hi is a pair of words, word 2j in the low half and word
+	// 2j + 1 in the high half, with lo holding blocks 0-3 and hi blocks 4-7. Mul
+	// is the widening multiply for the instruction set being built for.
+	template<typename Mul>
+	THREADED_RANDS_INLINE void philox_step(const philox_counter& counter, const std::uint64_t block, u64x8& lo, u64x8& hi)
+	{
+		const u64x8 offsets = {0, 1, 2, 3, 4, 5, 6, 7};
+		const u64x8 blocks = block + offsets;
+
+		u64x8 x0 = blocks & 0xffffffff;
+		u64x8 x1 = blocks >> 32;
+		u64x8 x2 = u64x8{} + (counter.stream & 0xffffffff);
+		u64x8 x3 = u64x8{} + (counter.stream >> 32);
+
+		std::uint32_t k0 = counter.key[0];
+		std::uint32_t k1 = counter.key[1];
+
+		// Unrolled, otherwise GCC keeps the vectors on the stack between rounds
+		#pragma GCC unroll 10
+		for(unsigned int round = 0; round < 10; round++)
+		{
+			u64x8 p0, p1;
+			Mul::apply(p0, x0, philox_m0);
+			Mul::apply(p1, x2, philox_m1);
+
+			x0 = (p1 >> 32) ^ x1 ^ k0;
+			x1 = p1 & 0xffffffff;
+			x2 = (p0 >> 32) ^ x3 ^ k1;
+			x3 = p0 & 0xffffffff;
+
+			k0 += philox_w0;
+			k1 += philox_w1;
+		}
+
+		// Words 0 and 1 and words 2 and 3 of each block, then put the blocks back in order
+		const u64x8 first = x0 | x1 << 32;
+		const u64x8 second = x2 | x3 << 32;
+
+		const u64x8 interleave_lo = {0, 8, 1, 9, 2, 10, 3, 11};
+		const u64x8 interleave_hi = {4, 12, 5, 13, 6, 14, 7, 15};
+		lo = __builtin_shuffle(first, second, interleave_lo);
+		hi = __builtin_shuffle(first, second, interleave_hi);
+	}
+
+	// The 8 words of pairs, each in the low half of an element
+	THREADED_RANDS_INLINE void split_words(const u64x8& pairs, u64x8& lo, u64x8& hi)
+	{
+		const u64x8 low = pairs & 0xffffffff;
+		const u64x8 high = pairs >> 32;
+
+		const u64x8 interleave_lo = {0, 8, 1, 9, 2, 10, 3, 11};
+		const u64x8 interleave_hi = {4, 12, 5, 13, 6, 14, 7, 15};
+		lo = __builtin_shuffle(low, high, interleave_lo);
+		hi = __builtin_shuffle(low, high, interleave_hi);
+	}
+
+	// A fill of n Bits-wide rands, 2 (64-bit) or 4 (32-bit) from each block in
+	// order, so the output is the same as calling get_rand() on the blocks in turn.
+	// The counter moves on by the blocks used, a block only partly used is dropped.
+	template<unsigned int Bits, typename Mul>
+	struct philox_kernel
+	{
+		static constexpr std::size_t per_block = 128 / Bits;
+		static constexpr std::size_t per_step = n_lanes * per_block;
+
+		template<typename Out>
+		THREADED_RANDS_INLINE static void put_partial_step(const Out& out, const std::size_t i, const u64x8& lo, const u64x8& hi, const std::size_t n)
+		{
+			if constexpr(Bits == 64)
+			{
+				put_pair_partial(out, i, lo, hi, n);
+			}
+			else
+			{
+				u64x8 w0, w1, w2, w3;
+				split_words(lo, w0, w1);
+				split_words(hi, w2, w3);
+
+				if(n <= 2 * n_lanes)
+				{
+					put_pair_partial(out, i, w0, w1, n);
+				}
+				else
+				{
+					out.put_pair(i, w0, w1);
+					put_pair_partial(out, i + 2 * n_lanes, w2, w3, n - 2 * n_lanes);
+				}
+			}
+		}
+
+		template<typename Out>
+		THREADED_RANDS_INLINE static void run(philox_counter& counter, const Out& out, const std::size_t n)
+		{
+			u64x8 lo, hi;
+
+			std::size_t i = 0;
+			for(; i + per_step <= n; i += per_step)
+			{
+				philox_step<Mul>(counter, counter.block, lo, hi);
+				counter.block += n_lanes;
+
+				if constexpr(Bits == 64)
+				{
+					out.put_pair(i, lo, hi);
+				}
+				else
+				{
+					u64x8 w0, w1, w2, w3;
+					split_words(lo, w0, w1);
+					split_words(hi, w2, w3);
+					out.put_pair(i, w0, w1);
+					out.put_pair(i + 2 * n_lanes, w2, w3);
+				}
+			}
+
+			if(i < n)
+			{
+				philox_step<Mul>(counter, counter.block, lo, hi);
+				counter.block += (n - i + per_block - 1) / per_block;
+
+				put_partial_step(out, i, lo, hi, n - i);
+			}
+		}
+	};
+}
+
+// Fill n elements of out with Bits-wide rands from the counter's next block on
+template<unsigned int Bits, typename Out>
+inline void philox_fill(philox_counter& counter, const Out& out, const std::size_t n)
+{
+	using namespace simd;
+	using kernel_fn = void (*)(philox_counter&, const Out&, std::size_t);
+
+	static const kernel_fn fn = select_kernel<kernel_fn>(&run_generic<philox_kernel<Bits, mul_wide_sse2>, philox_counter, Out>,
+														 &run_sse42<philox_kernel<Bits, mul_wide_sse2>, philox_counter, Out>,
+														 &run_avx2<philox_kernel<Bits, mul_wide_avx2>, philox_counter, Out>,
+														 &run_avx512<philox_kernel<Bits, mul_wide_avx512>, philox_counter, Out>);
+
+	fn(counter, out, n);
+}
+
+// ======================================
+// 		 	  Threefry4x64
+// ======================================
+
+// The other counter-based generator from Random123, a 256-bit block cipher
+// (the Threefish of Skein with its tweak dropped and fewer rounds) applied to a
+// 256-bit counter. Threefry-4x64-20 is the full strength version, 13 rounds is
+// the fewest Random123 still finds passes BigCrush. It only uses 64-bit adds,
+// rotates and xors, so it keeps up on CPUs without fast vector multiplies.
+
+// The counter is the block number in word 0 and a stream in word 1, words 2
+// and 3 are always 0. key[4] is the parity word of the key schedule
+struct threefry_counter
+{
+	std::uint64_t key[5];
+	// The next block to generate
+	std::uint64_t block;
+	std::uint64_t stream;
+};
+
+namespace simd
+{
+	// Rotation amounts for each round of 8, the first of each pair mixes words 0
+	// and 1 (even rounds) or 0 and 3 (odd rounds), the second words 2 and 3 or 2 and 1
+	constexpr unsigned int threefry_rotations[8][2] = {{14, 16}, {52, 57}, {23, 40}, {5, 37},
+													   {25, 33}, {46, 12}, {58, 22}, {32, 32}};
+
+	// Makes the key schedule's extra word, so no subkey is ever all zero
+	constexpr std::uint64_t threefry_parity = 0x1bd11bdaa9fc1a22;
+}
+
+// The key schedule for a key of 4 words
+inline void threefry_key(threefry_counter& counter, const std::uint64_t (&key)[4])
+{
+	counter.key[4] = simd::threefry_parity;
+
+	for(unsigned int i = 0; i < 4; i++)
+	{
+		counter.key[i] = key[i];
+		counter.key[4] ^= key[i];
+	}
+}
+
+namespace simd
+{
+	// Rounds of Threefry on a single block (T is std::uint64_t) or on 8 blocks
+	// at once (u64x8, with each word of the key schedule in every lane). A subkey
+	// is added every 4 rounds, after the last round as well when the number of
+	// rounds is a multiple of 4 as in Random123
+	template<unsigned int Rounds, typename T>
+	THREADED_RANDS_INLINE void threefry_rounds(const T (&key)[5], T& x0, T& x1, T& x2, T& x3)
+	{
+		x0 += key[0];
+		x1 += key[1];
+		x2 += key[2];
+		x3 += key[3];
+
+		// Unrolled so the rotations are constants
+		#pragma GCC unroll 20
+		for(unsigned int round = 0; round < Rounds; round++)
+		{
+			const unsigned int r0 = threefry_rotations[round % 8][0];
+			const unsigned int r1 = threefry_rotations[round % 8][1];
+
+			if(round % 2 == 0)
+			{
+				x0 += x1;
+				x1 = (x1 << r0 | x1 >> (64 - r0)) ^ x0;
+				x2 += x3;
+				x3 = (x3 << r1 | x3 >> (64 - r1)) ^ x2;
+			}
+			else
+			{
+				x0 += x3;
+				x3 = (x3 << r0 | x3 >> (64 - r0)) ^ x0;
+				x2 += x1;
+				x1 = (x1 << r1 | x1 >> (64 - r1)) ^ x2;
+			}
+
+			if(round % 4 == 3)
+			{
+				const unsigned int s = round / 4 + 1;
+				x0 += key[s % 5];
+				x1 += key[(s + 1) % 5];
+				x2 += key[(s + 2) % 5];
+				x3 += key[(s + 3) % 5] + std::uint64_t(s);
+			}
+		}
+	}
+}
+
+// The 4 words of a block
+template<unsigned int Rounds>
+inline void threefry4x64(const threefry_counter& counter, const std::uint64_t block, std::uint64_t (&out)[4])
+{
+	std::uint64_t x0 = block;
+	std::uint64_t x1 = counter.stream;
+	std::uint64_t x2 = 0;
+	std::uint64_t x3 = 0;
+
+	simd::threefry_rounds<Rounds>(counter.key, x0, x1, x2, x3);
+
+	out[0] = x0;
+	out[1] = x1;
+	out[2] = x2;
+	out[3] = x3;
+}
+
+namespace simd
+{
+	// 8 consecutive blocks, one in each lane, from block on. key and stream are the
+	// counter's key schedule and stream in every lane. The blocks are put back in
+	// order as the 32 words of out0 to out3
+	template<unsigned int Rounds>
+	THREADED_RANDS_INLINE void threefry_step(const u64x8 (&key)[5], const u64x8& stream, const std::uint64_t block,
+											 u64x8& out0, u64x8& out1, u64x8& out2, u64x8& out3)
+	{
+		const u64x8 offsets = {0, 1, 2, 3, 4, 5, 6, 7};
+
+		u64x8 x0 = block + offsets;
+		u64x8 x1 = stream;
+		u64x8 x2 = u64x8{};
+		u64x8 x3 = u64x8{};
+
+		threefry_rounds<Rounds>(key, x0, x1, x2, x3);
+
+		// Words 0 and 1 then words 2 and 3 of each block side by side, then the
+		// two pairs of each block together
+		const u64x8 interleave_lo = {0, 8, 1, 9, 2, 10, 3, 11};
+		const u64x8 interleave_hi = {4, 12, 5, 13, 6, 14, 7, 15};
+		const u64x8 a_lo = __builtin_shuffle(x0, x1, interleave_lo);
+		const u64x8 a_hi = __builtin_shuffle(x0, x1, interleave_hi);
+		const u64x8 b_lo = __builtin_shuffle(x2, x3, interleave_lo);
+		const u64x8 b_hi = __builtin_shuffle(x2, x3, interleave_hi);
+
+		const u64x8 blocks_lo = {0, 1, 8, 9, 2, 3, 10, 11};
+		const u64x8 blocks_hi = {4, 5, 12, 13, 6, 7, 14, 15};
+		out0 = __builtin_shuffle(a_lo, b_lo, blocks_lo);
+		out1 = __builtin_shuffle(a_lo, b_lo, blocks_hi);
+		out2 = __builtin_shuffle(a_hi, b_hi, blocks_lo);
+		out3 = __builtin_shuffle(a_hi, b_hi, blocks_hi);
+	}
+
+	// A fill of n Bits-wide rands, 4 (64-bit) or 8 (32-bit, the low half of each
+	// word first) from each block in order, so the output is the same as calling
+	// get_rand() on the blocks in turn. The counter moves on by the blocks used,
+	// a block only partly used is dropped.
+	template<unsigned int Bits, unsigned int Rounds>
+	struct threefry_kernel
+	{
+		static constexpr std::size_t per_block = 256 / Bits;
+		static constexpr std::size_t per_step = n_lanes * per_block;
+
+		// Each vector of words is 8 64-bit rands or 16 32-bit rands
+		static constexpr std::size_t per_vector = 64 / Bits * n_lanes;
+
+		template<typename Out>
+		THREADED_RANDS_INLINE static void put_vector(const Out& out, const std::size_t i, const u64x8& words)
+		{
+			if constexpr(Bits == 64)
+			{
+				out.put(i, words);
+			}
+			else
+			{
+				u64x8 lo, hi;
+				split_words(words, lo, hi);
+				out.put_pair(i, lo, hi);
+			}
+		}
+
+		template<typename Out>
+		THREADED_RANDS_INLINE static void put_vector_partial(const Out& out, const std::size_t i, const u64x8& words, const std::size_t n)
+		{
+			if constexpr(Bits == 64)
+			{
+				out.put_partial(i, words, n);
+			}
+			else
+			{
+				u64x8 lo, hi;
+				split_words(words, lo, hi);
+				put_pair_partial(out, i, lo, hi, n);
+			}
+		}
+
+		template<typename Out>
+		THREADED_RANDS_INLINE static void run(threefry_counter& counter, const Out& out, const std::size_t n)
+		{
+			// Broadcast once here, GCC makes a poor job of adding a scalar to a
+			// vector wider than the instruction set's
+			u64x8 key[5];
+			for(unsigned int k = 0; k < 5; k++)
+				key[k] = u64x8{} + counter.key[k];
+
+			const u64x8 stream = u64x8{} + counter.stream;
+
+			u64x8 words[4];
+
+			std::size_t i = 0;
+			for(; i + per_step <= n; i += per_step)
+			{
+				threefry_step<Rounds>(key, stream, counter.block, words[0], words[1], words[2], words[3]);
+				counter.block += n_lanes;
+
+				for(unsigned int v = 0; v < 4; v++)
+					put_vector(out, i + v * per_vector, words[v]);
+			}
+
+			if(i < n)
+			{
+				threefry_step<Rounds>(key, stream, counter.block, words[0], words[1], words[2], words[3]);
+				counter.block += (n - i + per_block - 1) / per_block;
+
+				for(unsigned int v = 0; i < n; v++, i += per_vector)
+				{
+					if(n - i >= per_vector)
+						put_vector(out, i, words[v]);
+					else
+						put_vector_partial(out, i, words[v], n - i);
+				}
+			}
+		}
+	};
+}
+
+// Fill n elements of out with Bits-wide rands from the counter's next block on
+template<unsigned int Bits, unsigned int Rounds, typename Out>
+inline void threefry_fill(threefry_counter& counter, const Out& out, const std::size_t n)
+{
+	simd::run_kernel<simd::threefry_kernel<Bits, Rounds>>(counter, out, n);
+}
+
+// ======================================
+// 		 	 	ChaCha
+// ======================================
+
+// Daniel J. Bernstein's ChaCha stream cipher, as a generator its keystream is
+// cryptographically secure for as long as the key is kept secret. ChaCha20 is
+// the full strength version used by TLS, 12 and 8 rounds are the reduced
+// versions with ChaCha12 still having a large security margin.
+
+// Each 64-byte block is made from the 4 constant words, the 8 words of the key,
+// a 64-bit block counter (words 12 and 13) and a 64-bit stream (words 14 and 15),
+// the layout of the original ChaCha rather than the 96-bit nonce of RFC 8439.
+struct chacha_counter
+{
+	std::uint32_t key[8];
+	// The next block to generate
+	std::uint64_t block;
+	std::uint64_t stream;
+};
+
+namespace simd
+{
+	// "expand 32-byte k"
+	constexpr std::uint32_t chacha_constants[4] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+
+	typedef std::uint8_t u8x32 __attribute__((vector_size(32)));
+
+	// Rotate each word left by R. For AVX2 the rotations by whole bytes are done as
+	// a single byte shuffle rather than two shifts and an or, AVX-512 has rotates
+	template<unsigned int R, typename T>
+	THREADED_RANDS_INLINE void chacha_rotate(T& x)
+	{
+		if constexpr(sizeof(T) == 32 && R == 16)
+		{
+			const u8x32 rot16 = {2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+								 18, 19, 16, 17, 22, 23, 20, 21, 26, 27, 24, 25, 30, 31, 28, 29};
+			x = (T)__builtin_shuffle((u8x32)x, rot16);
+		}
+		else if constexpr(sizeof(T) == 32 && R == 8)
+		{
+			const u8x32 rot8 = {3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+								19, 16, 17, 18, 23, 20, 21, 22, 27, 24, 25, 26, 31, 28, 29, 30};
+			x = (T)__builtin_shuffle((u8x32)x, rot8);
+		}
+		else
+		{
+			x = x << R | x >> (32 - R);
+		}
+	}
+
+	// Quarter round on a single block (T is std::uint32_t) or on a vector of blocks
+	template<typename T>
+	THREADED_RANDS_INLINE void chacha_quarter(T& a, T& b, T& c, T& d)
+	{
+		a += b; d ^= a; chacha_rotate<16>(d);
+		c += d; b ^= c; chacha_rotate<12>(b);
+		a += b; d ^= a; chacha_rotate<8>(d);
+		c += d; b ^= c; chacha_rotate<7>(b);
+	}
+
+	// Rounds of ChaCha, a column round then a diagonal round each time round
+	template<unsigned int Rounds, typename T>
+	THREADED_RANDS_INLINE void chacha_rounds(T (&x)[16])
+	{
+		static_assert(Rounds % 2 == 0, "ChaCha runs an even number of rounds");
+
+		// Unrolled or GCC keeps the 16 vectors on the stack
+		#pragma GCC unroll 10
+		for(unsigned int round = 0; round < Rounds; round += 2)
+		{
+			chacha_quarter(x[0], x[4], x[8], x[12]);
+			chacha_quarter(x[1], x[5], x[9], x[13]);
+			chacha_quarter(x[2], x[6], x[10], x[14]);
+			chacha_quarter(x[3], x[7], x[11], x[15]);
+
+			chacha_quarter(x[0], x[5], x[10], x[15]);
+			chacha_quarter(x[1], x[6], x[11], x[12]);
+			chacha_quarter(x[2], x[7], x[8], x[13]);
+			chacha_quarter(x[3], x[4], x[9], x[14]);
+		}
+	}
+
+	// The keystream is worked out with one block in each 32-bit lane of vectors as
+	// wide as the instruction set's registers, so the 16 words of state fit in
+	// registers: 4 blocks at once for SSE, 8 for AVX2 and 16 for AVX-512
+	typedef std::uint32_t u32x4 __attribute__((vector_size(16)));
+	typedef std::uint32_t u32x8 __attribute__((vector_size(32)));
+
+	template<unsigned int N>
+	struct chacha_vector;
+
+	template<>
+	struct chacha_vector<4> { typedef u32x4 type; };
+
+	template<>
+	struct chacha_vector<8> { typedef u32x8 type; };
+
+	template<>
+	struct chacha_vector<16> { typedef u32x16 type; };
+
+	// One stage of an N x N transpose of x[0] to x[N - 1], swapping bit H of the row
+	// number with bit H of the column number. lo and hi shuffle the rows r and r + H
+	template<unsigned int H, unsigned int N, typename V>
+	THREADED_RANDS_INLINE void transpose_stage(V* x, const V& lo, const V& hi)
+	{
+		for(unsigned int r = 0; r < N; r++)
+		{
+			if(r & H)
+				continue;
+
+			const V a = x[r];
+			const V b = x[r + H];
+			x[r] = __builtin_shuffle(a, b, lo);
+			x[r + H] = __builtin_shuffle(a, b, hi);
+		}
+	}
+
+	template<unsigned int N, typename V>
+	THREADED_RANDS_INLINE void transpose(V* x)
+	{
+		if constexpr(N == 16)
+		{
+			transpose_stage<8, N>(x, V{0, 1, 2, 3, 4, 5, 6, 7, 16, 17, 18, 19, 20, 21, 22, 23},
+								  V{8, 9, 10, 11, 12, 13, 14, 15, 24, 25, 26, 27, 28, 29, 30, 31});
+			transpose_stage<4, N>(x, V{0, 1, 2, 3, 16, 17, 18, 19, 8, 9, 10, 11, 24, 25, 26, 27},
+								  V{4, 5, 6, 7, 20, 21, 22, 23, 12, 13, 14, 15, 28, 29, 30, 31});
+			transpose_stage<2, N>(x, V{0, 1, 16, 17, 4, 5, 20, 21, 8, 9, 24, 25, 12, 13, 28, 29},
+								  V{2, 3, 18, 19, 6, 7, 22, 23, 10, 11, 26, 27, 14, 15, 30, 31});
+			transpose_stage<1, N>(x, V{0, 16, 2, 18, 4, 20, 6, 22, 8, 24, 10, 26, 12, 28, 14, 30},
+								  V{1, 17, 3, 19, 5, 21, 7, 23, 9, 25, 11, 27, 13, 29, 15, 31});
+		}
+		else if constexpr(N == 8)
+		{
+			transpose_stage<4, N>(x, V{0, 1, 2, 3, 8, 9, 10, 11}, V{4, 5, 6, 7, 12, 13, 14, 15});
+			transpose_stage<2, N>(x, V{0, 1, 8, 9, 4, 5, 12, 13}, V{2, 3, 10, 11, 6, 7, 14, 15});
+			transpose_stage<1, N>(x, V{0, 8, 2, 10, 4, 12, 6, 14}, V{1, 9, 3, 11, 5, 13, 7, 15});
+		}
+		else
+		{
+			transpose_stage<2, N>(x, V{0, 1, 4, 5}, V{2, 3, 6, 7});
+			transpose_stage<1, N>(x, V{0, 4, 2, 6}, V{1, 5, 3, 7});
+		}
+	}
+
+	// N consecutive blocks, one in each lane, from block on. input holds the
+	// constants, key and stream in every lane. Afterwards words[b] is the 16 words of block b
+	template<unsigned int Rounds, unsigned int N, typename V>
+	THREADED_RANDS_INLINE void chacha_step(V (&input)[16], const std::uint64_t block, u32x16 (&words)[N])
+	{
+		V offsets;
+		for(unsigned int l = 0; l < N; l++)
+			offsets[l] = l;
+
+		// The 64-bit counter of each lane as its low and high words, carrying
+		// into the high word in the lanes where the low word wraps around
+		const V block_lo = V{} + static_cast<std::uint32_t>(block);
+		input[12] = block_lo + offsets;
+		input[13] = (V{} + static_cast<std::uint32_t>(block >> 32)) - (V)(input[12] < block_lo);
+
+		V x[16];
+		for(unsigned int k = 0; k < 16; k++)
+			x[k] = input[k];
+
+		chacha_rounds<Rounds>(x);
+
+		for(unsigned int k = 0; k < 16; k++)
+			x[k] += input[k];
+
+		// Each vector is one word of all the blocks. Turn each run of N words round
+		// so x[g * N + b] is the gth run of words of block b, then join the runs up
+		for(unsigned int g = 0; g < 16 / N; g++)
+			transpose<N>(x + g * N);
+
+		for(unsigned int b = 0; b < N; b++)
+			for(unsigned int g = 0; g < 16 / N; g++)
+				std::memcpy(reinterpret_cast<char*>(&words[b]) + g * sizeof(V), &x[g * N + b], sizeof(V));
+	}
+
+	// A fill of n Bits-wide rands taken from the keystream in order, 64-bit rands
+	// are 8 bytes of it read as a little-endian int. N blocks are made at once. The
+	// counter moves on by the blocks used, a block only partly used is dropped.
+	template<unsigned int Bits, unsigned int Rounds, unsigned int N>
+	struct chacha_kernel
+	{
+		typedef typename chacha_vector<N>::type V;
+
+		static constexpr std::size_t per_block = 512 / Bits;
+		static constexpr std::size_t per_step = N * per_block;
+
+		template<typename Out>
+		THREADED_RANDS_INLINE static void put_block(const Out& out, const std::size_t i, const u32x16& words)
+		{
+			if constexpr(Bits == 64)
+			{
+				out.put(i, (u64x8)words);
+			}
+			else
+			{
+				u64x8 lo, hi;
+				split_words((u64x8)words, lo, hi);
+				out.put_pair(i, lo, hi);
+			}
+		}
+
+		template<typename Out>
+		THREADED_RANDS_INLINE static void put_block_partial(const Out& out, const std::size_t i, const u32x16& words, const std::size_t n)
+		{
+			if constexpr(Bits == 64)
+			{
+				out.put_partial(i, (u64x8)words, n);
+			}
+			else
+			{
+				u64x8 lo, hi;
+				split_words((u64x8)words, lo, hi);
+				put_pair_partial(out, i, lo, hi, n);
+			}
+		}
+
+		template<typename Out>
+		THREADED_RANDS_INLINE static void run(chacha_counter& counter, const Out& out, const std::size_t n)
+		{
+			// Everything but the block counter is the same in every lane, broadcast once here
+			V input[16];
+			for(unsigned int k = 0; k < 4; k++)
+				input[k] = V{} + chacha_constants[k];
+			for(unsigned int k = 0; k < 8; k++)
+				input[4 + k] = V{} + counter.key[k];
+			input[14] = V{} + static_cast<std::uint32_t>(counter.stream);
+			input[15] = V{} + static_cast<std::uint32_t>(counter.stream >> 32);
+
+			u32x16 words[N];
+
+			std::size_t i = 0;
+			for(; i + per_step <= n; i += per_step)
+			{
+				chacha_step<Rounds, N>(input, counter.block, words);
+				counter.block += N;
+
+				for(unsigned int b = 0; b < N; b++)
+					put_block(out, i + b * per_block, words[b]);
+			}
+
+			if(i < n)
+			{
+				chacha_step<Rounds, N>(input, counter.block, words);
+				counter.block += (n - i + per_block - 1) / per_block;
+
+				for(unsigned int b = 0; i < n; b++, i += per_block)
+				{
+					if(n - i >= per_block)
+						put_block(out, i, words[b]);
+					else
+						put_block_partial(out, i, words[b], n - i);
+				}
+			}
+		}
+	};
+}
+
+// Fill n elements of out with Bits-wide rands from the counter's next block on
+template<unsigned int Bits, unsigned int Rounds, typename Out>
+inline void chacha_fill(chacha_counter& counter, const Out& out, const std::size_t n)
+{
+	using namespace simd;
+	using kernel_fn = void (*)(chacha_counter&, const Out&, std::size_t);
+
+	static const kernel_fn fn = select_kernel<kernel_fn>(&run_generic<chacha_kernel<Bits, Rounds, 4>, chacha_counter, Out>,
+														 &run_sse42<chacha_kernel<Bits, Rounds, 4>, chacha_counter, Out>,
+														 &run_avx2<chacha_kernel<Bits, Rounds, 8>, chacha_counter, Out>,
+														 &run_avx512<chacha_kernel<Bits, Rounds, 16>, chacha_counter, Out>);
+
+	fn(counter, out, n);
+}
+
+// ======================================
+// 		 	  Bernoulli bits
+// ======================================
+
+// Words of bits each set with probability p, for p a 64-bit fixed point fraction.
+// Each bit compares its own uniform number U against p, a binary digit at a
+// time from the top. At each digit the bits still undecided take one new random
+// digit of U each: if p's digit is 1 a bit whose digit of U is 0 has U < p and
+// is set, if p's digit is 0 a bit whose digit of U is 1 has U > p and is clear,
+// the rest carry on to the next digit. Each random digit decides its bit half
+// the time so a word takes 128 random bits, or two draws, on average. Bits still
+// undecided once the digits of p run out have U >= p and are left clear.
+
+// The new digits are only handed to the undecided bits (BMI2's pdep), so no
+// random bits are wasted on bits that are already decided. Without BMI2 the
+// same deposit is done in software, which gives the same words but is slower.
+
+// Random bits left over from the words drawn so far, used from the lowest bit up
+struct bit_reservoir
+{
+	std::uint64_t bits = 0;
+	unsigned int n_bits = 0;
+
+	// At least the next k <= 64 bits in the low bits of the result, which may have
+	// more bits above them. next() gives a new word of random bits when needed
+	template<typename Next>
+	THREADED_RANDS_INLINE std::uint64_t take(const unsigned int k, Next& next)
+	{
+		std::uint64_t result = bits;
+
+		if(k <= n_bits)
+		{
+			bits = (k < 64) ? bits >> k : 0;
+			n_bits -= k;
+		}
+		else
+		{
+			// n_bits < k <= 64 here
+			const std::uint64_t fresh = next();
+			result |= fresh << n_bits;
+			bits = (k - n_bits < 64) ? fresh >> (k - n_bits) : 0;
+			n_bits += 64 - k;
+		}
+
+		return result;
+	}
+};
+
+namespace simd
+{
+	// Put the low bits of src into the set bits of mask, lowest first. This is the
+	// expand of Hacker's Delight (section 7-5), which moves each bit into place in
+	// six shifts of 1, 2, 4, ... 32 places rather than a bit at a time
+	THREADED_RANDS_INLINE std::uint64_t deposit_bits(std::uint64_t src, std::uint64_t mask)
+	{
+		const std::uint64_t mask_in = mask;
+
+		// The bits to move by 2^j places in step j
+		std::uint64_t moves[6];
+
+		std::uint64_t zeros_right = ~mask << 1;
+		for(unsigned int j = 0; j < 6; j++)
+		{
+			// Parallel prefix of the zeros to the right of each bit of the mask
+			std::uint64_t parity = zeros_right ^ (zeros_right << 1);
+			parity ^= parity << 2;
+			parity ^= parity << 4;
+			parity ^= parity << 8;
+			parity ^= parity << 16;
+			parity ^= parity << 32;
+
+			moves[j] = parity & mask;
+			mask = (mask ^ moves[j]) | (moves[j] >> (1u << j));
+			zeros_right &= ~parity;
+		}
+
+		for(unsigned int j = 6; j-- > 0;)
+			src = (src & ~moves[j]) | ((src << (1u << j)) & moves[j]);
+
+		return src & mask_in;
+	}
+
+#if defined(THREADED_RANDS_X86_SIMD)
+	// Not always_inline as it can only be inlined into code built for BMI2,
+	// which bernoulli_words is once it is inlined into bernoulli_bmi2
+	THREADED_RANDS_TARGET_AVX2
+	inline std::uint64_t deposit_bits_bmi2(const std::uint64_t src, const std::uint64_t mask) { return _pdep_u64(src, mask); }
+#endif
+
+	template<bool BMI2, typename Next>
+	THREADED_RANDS_INLINE void bernoulli_words(Next& next, std::uint64_t* out, const std::size_t n, const std::uint64_t p)
+	{
+		bit_reservoir reservoir;
+
+		for(std::size_t i = 0; i < n; i++)
+		{
+			std::uint64_t result = 0;
+			std::uint64_t undecided = ~std::uint64_t(0);
+
+			for(std::uint64_t digits = p; undecided != 0 && digits != 0; digits <<= 1)
+			{
+				const std::uint64_t src = reservoir.take(__builtin_popcountll(undecided), next);
+
+				std::uint64_t u;
+			#if defined(THREADED_RANDS_X86_SIMD)
+				if constexpr(BMI2)
+					u = deposit_bits_bmi2(src, undecided);
+				else
+			#endif
+					u = (undecided == ~std::uint64_t(0)) ? src : deposit_bits(src, undecided);
+
+				if(digits >> 63)
+				{
+					result |= undecided & ~u;
+					undecided = u;
+				}
+				else
+				{
+					undecided &= ~u;
+				}
+			}
+
+			out[i] = result;
+		}
+	}
+
+	template<typename Next>
+	inline void bernoulli_generic(Next& next, std::uint64_t* out, const std::size_t n, const std::uint64_t p)
+	{
+		bernoulli_words<false>(next, out, n, p);
+	}
+
+	template<typename Next>
+	THREADED_RANDS_TARGET_AVX2
+	inline void bernoulli_bmi2(Next& next, std::uint64_t* out, const std::size_t n, const std::uint64_t p)
+	{
+		bernoulli_words<true>(next, out, n, p);
+	}
+}
+
+// Fill n words with bits set with probability p / 2^64, taking random words from next().
+// pdep is used from the avx2 level up, which includes BMI2
+template<typename Next>
+inline void bernoulli_fill(Next& next, std::uint64_t* out, const std::size_t n, const std::uint64_t p)
+{
+	using bernoulli_fn = void (*)(Next&, std::uint64_t*, std::size_t, std::uint64_t);
+
+	static const bernoulli_fn fn = select_kernel<bernoulli_fn>(&simd::bernoulli_generic<Next>, &simd::bernoulli_generic<Next>,
+															   &simd::bernoulli_bmi2<Next>, &simd::bernoulli_bmi2<Next>);
+
+	fn(next, out, n, p);
+}
+
+#endif
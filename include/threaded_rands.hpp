@@ -8,40 +8,134 @@
 #include <type_traits>
 #include <cstdlib>
 #include <variant>
-#include <omp.h>
+#include <bitset>
+#include <initializer_list>
+
+#if defined(_WIN64)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
 
 #include "generators.hpp"
+#include "topology.hpp"
+#include "worker_pool.hpp"
+
+enum class generator_type{xoro128, pcg, jsf, pcg_setseq, philox, threefry, threefry13, xoshiro256pp, xoshiro256ss, sfc, chacha, chacha12, chacha8};
 
-enum class generator_type{xoro128, pcg, jsf};
+// How a contiguous buffer is shared out between threads
+// thread - one chunk per thread, each filled by that thread's generator
+// block  - fixed-size blocks each with their own substream, the output only
+//          depends on the master seed and block size, not the number of threads
+enum class partition_type{thread, block};
+
+// Warn the first time any Threaded_rands is asked for more threads than there are CPUs
+inline void warn_oversubscribed(const unsigned int n_selected, const unsigned int n_available)
+{
+	static std::once_flag warned;
+	std::call_once(warned, [=]
+	{
+		std::cerr << "Number of requested threads (" << n_selected << ") exceeds the " << n_available 
+				  << " CPUs available to this process, the threads will be competing for CPU time.\n";
+	});
+}
+
+// The CPUs to pin the worker threads to, one thread for each. A type of its own so a
+// list of CPUs can't be taken for a number of threads, Threaded_rands({3}, sel) is
+// 3 threads whereas Threaded_rands(pinned_cores{3}, sel) is one thread on CPU 3
+struct pinned_cores
+{
+	std::vector<unsigned int> cores;
+
+	explicit pinned_cores(std::initializer_list<unsigned int> list) : cores(list) {}
+	explicit pinned_cores(std::vector<unsigned int> list) : cores(std::move(list)) {}
+};
 
 template<typename result_type, typename state_type>
 class Threaded_rands
 {
 protected:
-	// Gets hardware thread information - can be used to limit
-	// the number of threads requested to the number available in hardware
-	unsigned int get_thread_info(const int nt);
-	// In case C++11 hardware detection methods fail
-	unsigned int backup_thread_count();
+	// Gets hardware thread information - with nt = 0 this is the number of
+	// CPUs this process can use, taking its affinity mask and cgroup quota into account
+	static unsigned int get_thread_info(const unsigned int nt);
+	// In case the other hardware detection methods fail
+	static unsigned int backup_thread_count();
+
+	// The CPUs to pin n workers to, spread over the NUMA nodes using
+	// only the CPUs this process is allowed to run on
+	static std::vector<unsigned int> worker_cpus(const unsigned int n)
+	{
+		return numa_topology::detect().restrict_to(allowed_cpus()).spread(n);
+	}
 	// Number of threads to be used
 	unsigned int n_threads = 1;	
 
+	// One persistent worker per generator, worker i only ever uses generator i. 
+	// The workers are spread evenly over the NUMA nodes, each generator is 
+	// allocated by its worker so it lives on that worker's node
+	worker_pool pool;
+
+	// Seed used by the generators that can be seeded deterministically
+	std::uint64_t master_seed = 0;
+
+	// The generator picked when the generators were created
+	generator_type selection = generator_type::pcg;
+
+	// Block partitioning, the number of elements in each block and the
+	// number of blocks used so far in the sequence defined by the master seed
+	partition_type partition = partition_type::thread;
+	std::size_t block_size = std::size_t(1) << 16;
+	std::uint64_t block_offset = 0;
+
 	// using gen_type = std::variant<pcg64_wrap, pcg32_wrap, xoroshiro128, jsf64_wrap>;
-	using gen_type = std::variant<pcg_unique<state_type>, xoroshiro128<state_type>, jsf<state_type>>;
+	using gen_type = std::variant<pcg_unique<state_type>, xoroshiro128<state_type>, jsf<state_type>, pcg_setseq<state_type>, philox<state_type>,
+								  threefry<state_type>, threefry<state_type, 13>, xoshiro256<state_type>, xoshiro256<state_type, true>,
+								  sfc<state_type>, chacha<state_type>, chacha<state_type, 12>, chacha<state_type, 8>>;
+
+	// Generators used by different threads are kept on separate cache lines so a
+	// draw on one thread doesn't invalidate the state held by its neighbour.
+	// 128 bytes rather than 64 as the adjacent-line prefetcher on x86 pulls in
+	// cache lines in pairs.
+	static constexpr std::size_t cache_line = 128;
+
+	struct alignas(cache_line) gen_slot
+	{
+		template<typename G, typename... Args>
+		gen_slot(std::in_place_type_t<G> g, const Args... args) : gen{g, args...} {}
 
-	// Store the PRNG object created for each thread
-	std::vector<gen_type> gen_vec;
+		gen_type gen;
+	};
+
+	// Store the PRNG object created for each thread, each slot is allocated
+	// by the thread that will be using it
+	std::vector<std::unique_ptr<gen_slot>> gen_vec;
+
+	// Create the slot holding the generator for a single thread
+	std::unique_ptr<gen_slot> make_slot(const generator_type sel, const unsigned int thread_id) const;
+
+	// A single read from the entropy source for when a master seed isn't given
+	static std::uint64_t entropy_seed();
+
+	// Create a generator for each of the n_threads threads
+	void create_generators(const generator_type sel);
 
 	// Number of bits in each type
-	const int RTYPE_BITS = 8*sizeof(result_type);
-	const int STYPE_BITS = 8*sizeof(state_type);
+	static constexpr int RTYPE_BITS = 8*sizeof(result_type);
+	static constexpr int STYPE_BITS = 8*sizeof(state_type);
 
 	// This is used in the conversion of int types, stop it being negative
-	const int bit_shift = std::max(0, STYPE_BITS - RTYPE_BITS);
+	static constexpr int bit_shift = std::max(0, STYPE_BITS - RTYPE_BITS);
 
 	// For int to double conversion using the quick method
-	const unsigned int right_shift = ((RTYPE_BITS == 64) ? 11 : 9);
-	const unsigned int left_shift = ((RTYPE_BITS == 64) ? 53 : 23);
+	static constexpr unsigned int right_shift = ((RTYPE_BITS == 64) ? 11 : 9);
+	static constexpr unsigned int left_shift = ((RTYPE_BITS == 64) ? 53 : 23);
 
 	// TODO - Properly check to see if 16-bit types are requested 
 
@@ -49,33 +143,300 @@ protected:
 	// This needs a better name
 	using int_type = typename std::conditional<8*sizeof(state_type) == 64, __uint128_t, uint64_t>::type;
 
+	// Resolve the generator held for thread_id once and run f against the concrete
+	// generator type. The fill loops below are written against the concrete type
+	// so get_rand() can be inlined rather than going through std::visit per draw.
+	template<typename F>
+	decltype(auto) visit_generator(const unsigned int thread_id, F&& f)
+	{
+		return std::visit(std::forward<F>(f), gen_vec[thread_id]->gen);
+	}
+
+	// Whether a generator's SIMD bulk fill can write straight into a buffer of T,
+	// the output has to be full width and T the same size of int as the state
+	template<typename G, typename T>
+	static constexpr bool bulk_fillable()
+	{
+		if constexpr(std::is_integral<T>::value && !std::is_same<T, bool>::value)
+			return has_bulk_fill<G>::value && bit_shift == 0 &&
+				   std::is_same<typename std::make_unsigned<T>::type, state_type>::value;
+		else
+			return false;
+	}
+
+	// Whether each rand is split into several T, for ints narrower than the state
+	template<typename T>
+	static constexpr bool splittable()
+	{
+		return std::is_integral<T>::value && !std::is_same<T, bool>::value && sizeof(T) < sizeof(state_type);
+	}
+
+	// Fill n_bytes of out with the bytes of whole rands, used for ints narrower than the state
+	// and for raw bits
+	template<typename G>
+	static void fill_raw_bytes(G& g, unsigned char* out, const std::size_t n_bytes);
+
+	// Byte fills shorter than this are run on the calling thread
+	static constexpr std::size_t parallel_bytes = std::size_t(1) << 16;
+	// Byte fills at least this long on a thread bypass the cache
+	static constexpr std::size_t stream_bytes = std::size_t(1) << 22;
+
+	// Fill [first:last) of a raw byte region at any alignment
+	template<typename G>
+	static void fill_region(G& g, unsigned char* first, unsigned char* last);
+
+	// Fill [first:last) with words whose bits are each set with probability p
+	template<typename G>
+	static void fill_bernoulli(G& g, std::uint64_t* first, std::uint64_t* last, const double p);
+
+	// Bit i of a bitset is bit i % 64 of word i / 64
+	template<std::size_t N>
+	static void words_to_bitset(const std::vector<std::uint64_t>& words, std::bitset<N>& bits)
+	{
+		for(std::size_t i = 0; i < N; i++)
+			bits[i] = (words[i / 64] >> (i % 64)) & 1;
+	}
+
+	// Fill [first:last) with rands from a concrete generator
+	template<typename G, typename T>
+	static void fill_rands(G& g, T* first, T* last)
+	{
+		if constexpr(bulk_fillable<G, T>())
+		{
+			g.fill(simd::int_out<state_type>{reinterpret_cast<state_type*>(first)}, last - first);
+			return;
+		}
+
+		if constexpr(splittable<T>())
+		{
+			fill_raw_bytes(g, reinterpret_cast<unsigned char*>(first), (last - first) * sizeof(T));
+			return;
+		}
+
+		for(; first != last; ++first)
+			*first = static_cast<result_type>(g.get_rand() >> bit_shift);
+	}
+
+	// Fill [first:last) with doubles [0:1) from a concrete generator
+	template<typename G>
+	static void fill_doubles(G& g, double* first, double* last)
+	{
+		// Generators with a bulk fill convert each vector of rands as it is
+		// generated, giving exactly what double_conv would
+		if constexpr(has_bulk_fill<G>::value)
+		{
+			g.fill(simd::double_out{first, bit_shift + right_shift, 1.0 / double(std::uint64_t(1) << left_shift)}, last - first);
+			return;
+		}
+
+		for(; first != last; ++first)
+			*first = double_conv(static_cast<result_type>(g.get_rand() >> bit_shift));
+	}
+
+	// Fill [first:last) with floats from a concrete generator, convert turns each 32-bit
+	// word into a float. Both halves of a 64-bit rand are used, the low half first, after
+	// the same mix as the narrow ints for generators with weak low bits.
+	template<typename G, typename Convert>
+	static void fill_floats(G& g, float* first, float* last, const Convert& convert);
+
+	// The boundary between the chunks of [data:data+n) filled by thread k-1 and thread k,
+	// rounded up so each chunk starts on a cache line where the buffer allows it
+	template<typename T>
+	std::size_t chunk_boundary(const T* data, const std::size_t n, const unsigned int k) const;
+
+	// The generator for a block in the sequence with pcg, each block has its own pcg
+	// stream hashed from the master seed so it doesn't depend on which thread fills it
+	pcg_setseq<state_type> block_generator(const std::uint64_t block) const
+	{
+		splitmix64<std::uint64_t> seed_gen(master_seed);
+
+		return pcg_setseq<state_type>::substream(seed_gen(), block);
+	}
+
+	static bool is_chacha(const generator_type sel)
+	{
+		return sel == generator_type::chacha || sel == generator_type::chacha12 || sel == generator_type::chacha8;
+	}
+
+	// Run f on a generator of type G for one of the master seed's streams
+	template<typename G, typename F>
+	void with_substream(const std::uint64_t stream, F&& f) const
+	{
+		auto g = G::substream(master_seed, stream);
+		f(g);
+	}
+
+	// Run f on a ChaCha generator for a block's stream. It has thread 0's key rather
+	// than one made from the master seed so the blocks stay unpredictable, which
+	// means another Threaded_rands with the same master seed won't repeat them
+	template<typename G, typename F>
+	void with_chacha_block(const std::uint64_t stream, F&& f) const
+	{
+		auto g = std::get<G>(gen_vec[0]->gen).substream(stream);
+		f(g);
+	}
+
+	// Run f on the generator for a block. Each generator fills the blocks with its own
+	// kind of generator, seeded from the master seed on the streams from 2^63 up so
+	// they don't overlap the threads' streams. pcg_unique takes its stream from its
+	// address, so pcg fills the blocks from the pcg_setseq substreams, the same pcg
+	// generator with the stream set explicitly
+	template<typename F>
+	void with_block_generator(const std::uint64_t block, F&& f) const
+	{
+		const std::uint64_t stream = std::uint64_t(1) << 63 | block;
+
+		switch(selection)
+		{
+			case generator_type::xoro128:
+				with_substream<xoroshiro128<state_type>>(stream, f);
+				return;
+			case generator_type::jsf:
+				with_substream<jsf<state_type>>(stream, f);
+				return;
+			case generator_type::philox:
+				with_substream<philox<state_type>>(stream, f);
+				return;
+			case generator_type::threefry:
+				with_substream<threefry<state_type>>(stream, f);
+				return;
+			case generator_type::threefry13:
+				with_substream<threefry<state_type, 13>>(stream, f);
+				return;
+			case generator_type::xoshiro256pp:
+				with_substream<xoshiro256<state_type>>(stream, f);
+				return;
+			case generator_type::xoshiro256ss:
+				with_substream<xoshiro256<state_type, true>>(stream, f);
+				return;
+			case generator_type::sfc:
+				with_substream<sfc<state_type>>(stream, f);
+				return;
+			case generator_type::chacha:
+				with_chacha_block<chacha<state_type>>(stream, f);
+				return;
+			case generator_type::chacha12:
+				with_chacha_block<chacha<state_type, 12>>(stream, f);
+				return;
+			case generator_type::chacha8:
+				with_chacha_block<chacha<state_type, 8>>(stream, f);
+				return;
+			case generator_type::pcg:
+			case generator_type::pcg_setseq:
+			default:
+			{
+				auto g = block_generator(block);
+				f(g);
+				return;
+			}
+		}
+	}
+
+	// Fill each row of a 2D vector or array, f is called as f(generator, first, last).
+	// Row i is filled by worker i % n_threads using that worker's generator, or
+	// with block partitioning the rows are cut into blocks shared out by work stealing
+	template<typename Rows, typename F>
+	void fill_rows(Rows& rows, F&& f);
+
+	// The part of [0:n) that thread_id fills first, the chunk for the thread
+	// partitioning or the run of blocks it starts with for the block partitioning
+	template<typename T>
+	std::pair<std::size_t, std::size_t> first_share(const T* data, const std::size_t n, const unsigned int thread_id) const;
+
+	// Split [data:data+n) into one chunk per thread (or into blocks) and have each 
+	// thread fill its own chunk, f is called as f(generator, first, last)
+	template<typename T, typename F>
+	void parallel_fill(T* data, const std::size_t n, F&& f);
+
+	// Lemire's method on a concrete generator, returns a rand in [0:range)
+	template<typename G>
+	static state_type bounded_rand(G& g, const state_type range);
+
+	// n raw rands from a concrete generator, from its SIMD lanes if it has them
+	template<typename G>
+	static void draw_raw(G& g, state_type* out, const std::size_t n)
+	{
+		if constexpr(has_bulk_fill<G>::value)
+		{
+			g.fill(simd::int_out<state_type>{out}, n);
+			return;
+		}
+
+		for(std::size_t i = 0; i < n; i++)
+			out[i] = g.get_rand();
+	}
+
+	// Fill [first:last) with rands [lower:upper) from a concrete generator, using
+	// Lemire's method on batches of raw rands
+	template<typename G>
+	static void fill_range(G& g, result_type* first, result_type* last, const result_type lower, const result_type upper);
+
 public:
     constexpr result_type min() { return 0; }
     // Where ~ performs a bitwise NOT on zero to get the max of that type
     constexpr result_type max() { return ~result_type(0); }
 
    // Default ctor, using the PCG64 PRNG and a single thread
-    Threaded_rands()
+    Threaded_rands() : pool{1}, master_seed{entropy_seed()}
     {  	   	
-   	 	gen_vec.push_back(pcg_unique<state_type>(0));	
+   	 	create_generators(generator_type::pcg);
     }
 
 	// Handle a number of threads and an optional generator selection argument
-	Threaded_rands(const unsigned int n, const generator_type sel = generator_type::pcg) : n_threads{n}
+	// Passing n = 0 uses one thread for each CPU this process can actually use
+	Threaded_rands(const unsigned int n, const generator_type sel = generator_type::pcg) 
+		: Threaded_rands(n, sel, entropy_seed()) {}
+
+	// With a master seed, generators that support it (pcg_setseq, philox, threefry, xoshiro256 and sfc) will give
+	// the same numbers on each thread every time. ChaCha is always keyed from std::random_device
+	Threaded_rands(const unsigned int n, const generator_type sel, const std::uint64_t seed) 
+		: n_threads{get_thread_info(n)}, pool{n_threads, worker_cpus(n_threads)}, master_seed{seed}
 	{					
-		// TODO - Implement thread number checking properly
-		// n_threads = get_thread_info(_n_threads);
+		create_generators(sel);
+	}
 
-		for(unsigned int thread_id = 0; thread_id < n; ++thread_id)
-	    {
-	        if(sel == generator_type::pcg)
-	        	gen_vec.push_back(pcg_unique<state_type>(thread_id));
-			if(sel == generator_type::xoro128)
-	        	gen_vec.push_back(xoroshiro128<state_type>(thread_id));
-	        if(sel == generator_type::jsf)
-	        	gen_vec.push_back(jsf<state_type>(thread_id));
-	    }
+	// Use one thread for each of the given CPUs, worker i is pinned to pinned.cores[i].
+	// An empty list is the same as n = 0
+	Threaded_rands(const pinned_cores& pinned, const generator_type sel = generator_type::pcg) 
+		: Threaded_rands(pinned, sel, entropy_seed()) {}
 
+	Threaded_rands(const pinned_cores& pinned, const generator_type sel, const std::uint64_t seed) 
+		: n_threads{pinned.cores.empty() ? get_thread_info(0) : static_cast<unsigned int>(pinned.cores.size())}, 
+		  pool{n_threads, pinned.cores.empty() ? worker_cpus(n_threads) : pinned.cores}, master_seed{seed}
+	{
+		create_generators(sel);
+	}
+
+	// The number of threads (and generators) in use
+	unsigned int get_n_threads() const { return n_threads; }
+	// Allocate a buffer for the contiguous fills whose pages are first written
+	// by the workers that will later fill them, so each part of the buffer is
+	// on the same NUMA node as the thread filling it
+	template<typename T>
+	numa_vector<T> allocate(const std::size_t n);
+
+	// The master seed in use, pass this back in to reproduce a run
+	std::uint64_t get_seed() const { return master_seed; }
+
+	// The instruction set the SIMD bulk fills run with: generic, sse4.2, avx2 or avx512.
+	// Set THREADED_RANDS_SIMD to one of these to force a lower one
+	static const char* simd_path() { return simd_level_name(active_simd_level()); }
+
+	// Select how the contiguous buffer fills are split between threads. With
+	// partition_type::block the output is the same for any number of threads,
+	// this also restarts the sequence of blocks from the first block. The ChaCha
+	// generators carry on from the next unused block instead, restarting would
+	// give out the same keystream again.
+	// Each block is filled by the selected generator, seeded from the master seed
+	// for the block, so xoro128 and jsf are reproducible in this mode too. pcg
+	// uses the pcg_setseq streams as its own depend on the generator's address
+	void set_partition(const partition_type p, const std::size_t n_block = std::size_t(1) << 16)
+	{
+		partition = p;
+		block_size = std::max<std::size_t>(1, n_block);
+
+		if(!is_chacha(selection))
+			block_offset = 0;
 	}
 
 	// Visitor lambda for accessing the vector of variants
@@ -83,11 +444,42 @@ public:
 
 	result_type get_rand(const unsigned int thread_id = 0)
 	{
-		state_type rand = std::visit(gen_visit, gen_vec[thread_id]);
+		state_type rand = std::visit(gen_visit, gen_vec[thread_id]->gen);
 
 		return rand >> bit_shift;
 	}
 
+	// The rand at position index of thread_id's stream, worked out directly without
+	// moving the generator. Only for the counter-based generators (philox, threefry
+	// and threefry13) whose streams depend only on the master seed and the thread
+	// number, std::logic_error is thrown for the others
+	result_type get_rand_at(const std::uint64_t index, const unsigned int thread_id = 0) const
+	{
+		return std::visit([=](const auto& g) -> result_type
+		{
+			if constexpr(has_random_access<std::decay_t<decltype(g)>>::value)
+				return g.at(index) >> bit_shift;
+			else
+				throw std::logic_error("get_rand_at needs a counter-based generator (philox, threefry or threefry13)");
+		}, gen_vec[thread_id]->gen);
+	}
+
+	// Move every thread's stream on by n long jumps (2^192 draws each) for the
+	// xoshiro256 generators, the others are left as they are. For several
+	// processes sharing one master seed call this with each process's rank
+	void long_jump(const unsigned int n = 1)
+	{
+		pool.run([&](const unsigned int thread_id)
+		{
+			visit_generator(thread_id, [&](auto& g)
+			{
+				if constexpr(has_long_jump<std::decay_t<decltype(g)>>::value)
+					for(unsigned int j = 0; j < n; j++)
+						g.long_jump();
+			});
+		});
+	}
+
 	double get_double(const unsigned int thread_id = 0)
 	{
 		return double_conv(get_rand(thread_id));
@@ -106,6 +498,9 @@ public:
 	void generate_range(std::vector<result_type>& vec, const unsigned int upper, const unsigned int thread_id);
 	void generate_range(std::vector<result_type>& vec, const unsigned int lower, const unsigned int upper, const unsigned int thread_id = 0);
 
+	// Fills a contiguous buffer of n ints [lower:upper) using all threads
+	void generate_range(result_type* data, const std::size_t n, const result_type lower, const result_type upper);
+
 	// Fills a 2D vector with 64-bit ints [lower:upper)
 	void generate_range(std::vector<std::vector<result_type>>& vec, const unsigned int upper);
 	void generate_range(std::vector<std::vector<result_type>>& vec, const unsigned int lower, const unsigned int upper);
@@ -113,7 +508,7 @@ public:
 	// This function currently just returns a double in the range [0:1)
 	// This method below result in a difference of ~ 1e-8 from dividing by UINT64_MAX	
 	// TODO - Check if this introduces a bias in the generated numbers.
-	inline double double_conv(const result_type v) {return ((state_type)(v >> right_shift)) / (double)(1L << left_shift);}
+	static inline double double_conv(const result_type v) {return ((state_type)(v >> right_shift)) / (double)(1L << left_shift);}
 
 	// Alternative - but slower in my measurements - versions that may be more precise / not have rounding errors ?
 	// inline double double_conv(const result_type v) { return v/double(max());}
@@ -125,62 +520,148 @@ public:
 	template<typename T>
 	void generate(std::vector<T>& vec, const unsigned int thread_id = 0)
 	{
-		for(auto& rand : vec)
-			rand = get_rand(thread_id);
+		visit_generator(thread_id, [&](auto& g){ fill_rands(g, vec.data(), vec.data() + vec.size()); });
+	}
+
+	// Fill a single contiguous buffer of n rands using all threads, the buffer is
+	// split into one cache-line-aligned chunk per thread
+	template<typename T>
+	void generate(T* data, const std::size_t n)
+	{
+		parallel_fill(data, n, [](auto& g, T* first, T* last){ fill_rands(g, first, last); });
 	}
 
 	// For 2D vectors
 	// Although any type can be passed here there will be an implicit conversion from uint64_t to T
+	// By default row i is filled by thread i % n_threads, so ragged rows can leave threads
+	// idle. To balance them use set_partition(partition_type::block, ...), which cuts the rows
+	// into blocks shared out by work stealing
 	template<typename T>
 	void generate_2D(std::vector<std::vector<T>>& vec)
 	{
-		// omp_set_dynamic(0);
-		#pragma omp parallel for
-		for(unsigned int i = 0; i < vec.size(); i++)
-		{
-			generate(vec[i], i);
-		}
+		fill_rows(vec, [](auto& g, T* first, T* last){ fill_rands(g, first, last); });
 	}
 
 	// For 2D arrays - shouldn't need higher dimensions than 2D - this is just for multiple threads
 	template<typename T, const std::size_t N>
 	void generate_2D(std::array<T, N>& arr)
 	{
-		// omp_set_dynamic(0);
-		#pragma omp parallel for
-		for(unsigned int i = 0; i < arr.size(); i++)
-		{
-			generate(arr[i], i);
-		}
+		fill_rows(arr, [](auto& g, auto* first, auto* last){ fill_rands(g, first, last); });
 	}
 
 	// Fills a one-dimensional vector with rands in the range [0, 1)
 	void generate_doubles(std::vector<double>& vec, const unsigned int thread_id = 0)
 	{
-		for(auto& rand : vec)
-			rand = double_conv(get_rand(thread_id));			
+		visit_generator(thread_id, [&](auto& g){ fill_doubles(g, vec.data(), vec.data() + vec.size()); });
+	}
+
+	// Fills a contiguous buffer of n doubles [0:1) using all threads
+	void generate_doubles(double* data, const std::size_t n)
+	{
+		parallel_fill(data, n, [](auto& g, double* first, double* last){ fill_doubles(g, first, last); });
+	}
+
+	// Fills a vector with floats [0:1), each with 24 random bits. Two floats are
+	// taken from each 64-bit rand
+	void generate_floats(std::vector<float>& vec, const unsigned int thread_id = 0)
+	{
+		visit_generator(thread_id, [&](auto& g){ fill_floats(g, vec.data(), vec.data() + vec.size(), simd::unit_float{}); });
+	}
+
+	// Fills a contiguous buffer of n floats [0:1) using all threads
+	void generate_floats(float* data, const std::size_t n)
+	{
+		parallel_fill(data, n, [](auto& g, float* first, float* last){ fill_floats(g, first, last, simd::unit_float{}); });
+	}
+
+	// Fills a vector with floats [lower:upper)
+	void generate_floats(std::vector<float>& vec, const float lower, const float upper, const unsigned int thread_id = 0)
+	{
+		const simd::float_range range(lower, upper);
+		visit_generator(thread_id, [&](auto& g){ fill_floats(g, vec.data(), vec.data() + vec.size(), range); });
+	}
+
+	// Fills a contiguous buffer of n floats [lower:upper) using all threads
+	void generate_floats(float* data, const std::size_t n, const float lower, const float upper)
+	{
+		const simd::float_range range(lower, upper);
+		parallel_fill(data, n, [&](auto& g, float* first, float* last){ fill_floats(g, first, last, range); });
+	}
+
+	// Fill n_bytes of raw memory at any alignment with random bytes, for payloads and
+	// scratch buffers. Long fills are split between the threads like the other
+	// contiguous fills, using the same partitioning.
+	void fill_bytes(void* data, const std::size_t n_bytes)
+	{
+		unsigned char* bytes = static_cast<unsigned char*>(data);
+
+		// Not worth waking the workers for
+		if(partition == partition_type::thread && n_bytes < parallel_bytes)
+		{
+			visit_generator(0, [&](auto& g){ fill_region(g, bytes, bytes + n_bytes); });
+			return;
+		}
+
+		parallel_fill(bytes, n_bytes, [](auto& g, unsigned char* first, unsigned char* last){ fill_region(g, first, last); });
+	}
+
+	// Fills packed words with fair random bits. These are the raw bits of the rands, 
+	// put through the same mix as the narrow ints for generators with weak low bits
+	void generate_bits(std::vector<std::uint64_t>& words, const unsigned int thread_id = 0)
+	{
+		visit_generator(thread_id, [&](auto& g){ fill_raw_bytes(g, reinterpret_cast<unsigned char*>(words.data()), words.size() * sizeof(std::uint64_t)); });
+	}
+
+	// Fills a contiguous buffer of n_words packed words of fair bits using all threads
+	void generate_bits(std::uint64_t* words, const std::size_t n_words)
+	{
+		parallel_fill(words, n_words, [](auto& g, std::uint64_t* first, std::uint64_t* last)
+		{
+			fill_raw_bytes(g, reinterpret_cast<unsigned char*>(first), (last - first) * sizeof(std::uint64_t));
+		});
+	}
+
+	template<std::size_t N>
+	void generate_bits(std::bitset<N>& bits, const unsigned int thread_id = 0)
+	{
+		std::vector<std::uint64_t> words((N + 63) / 64);
+		generate_bits(words, thread_id);
+		words_to_bitset(words, bits);
+	}
+
+	// Fills packed words with bits that are each set with probability p, taking about
+	// two rands per word whatever p is rather than one rand per bit
+	void generate_bernoulli(std::vector<std::uint64_t>& words, const double p, const unsigned int thread_id = 0)
+	{
+		visit_generator(thread_id, [&](auto& g){ fill_bernoulli(g, words.data(), words.data() + words.size(), p); });
+	}
+
+	// Fills a contiguous buffer of n_words Bernoulli words using all threads
+	void generate_bernoulli(std::uint64_t* words, const std::size_t n_words, const double p)
+	{
+		parallel_fill(words, n_words, [=](auto& g, std::uint64_t* first, std::uint64_t* last){ fill_bernoulli(g, first, last, p); });
+	}
+
+	template<std::size_t N>
+	void generate_bernoulli(std::bitset<N>& bits, const double p, const unsigned int thread_id = 0)
+	{
+		std::vector<std::uint64_t> words((N + 63) / 64);
+		generate_bernoulli(words, p, thread_id);
+		words_to_bitset(words, bits);
 	}
 
 	// Fills the vector with values [0:1)
 	template <typename T>
 	void generate_doubles_2D(std::vector<T>& vec)
 	{
-		#pragma omp parallel for
-		for(unsigned int i = 0; i < vec.size(); i++)
-		{
-			generate_doubles(vec[i], i);
-		}
+		fill_rows(vec, [](auto& g, double* first, double* last){ fill_doubles(g, first, last); });
 	}
 
 	// Fills the vector with values [0:1)
 	template <typename T, const std::size_t N>
 	void generate_doubles_2D(std::array<T, N>& vec)
 	{
-		#pragma omp parallel for
-		for(unsigned int i = 0; i < vec.size(); i++)
-		{
-			generate_doubles(vec[i], i);
-		}
+		fill_rows(vec, [](auto& g, double* first, double* last){ fill_doubles(g, first, last); });
 	}
 
 }; // End class
@@ -193,140 +674,538 @@ public:
 // http://www.pcg-random.org/posts/bounded-rands.html
 // Can use this for upper and lower bounds as in generate_range
 
-// For random numbers in a range [0:upper)
+// For random numbers in a range [0:range) from a concrete generator
+// The result is taken from the upper half of the product, the lower half
+// is only used to decide whether to reject
 template<typename result_type, typename state_type>
-result_type Threaded_rands<result_type, state_type>::get_bounded_rand(const result_type upper, const unsigned int thread_id)
+template<typename G>
+state_type Threaded_rands<result_type, state_type>::bounded_rand(G& g, const state_type range)
 {
 	// State type is the type returned from the generator
-	state_type x = get_rand(thread_id);
+	state_type x = g.get_rand();
 
-	int_type m = static_cast<int_type>(x) * static_cast<int_type>(upper);
+	int_type m = static_cast<int_type>(x) * static_cast<int_type>(range);
 
 	state_type l = static_cast<state_type>(m);
 
-	if (l < upper) 
+	if (l < range) 
 	{
-	    state_type t = -upper;
-	    if (t >= upper) 
+	    state_type t = -range;
+	    if (t >= range) 
 	    {
-	        t -= upper;
-	        if (t >= upper) 
-	            t %= upper;
+	        t -= range;
+	        if (t >= range) 
+	            t %= range;
 	    }
 	    while (l < t) 
 	    {
-	        x = get_rand(thread_id);
-	        m = int_type(x) * int_type(upper);
+	        x = g.get_rand();
+	        m = int_type(x) * int_type(range);
 	        l = static_cast<state_type>(m);
 	    }
 	}
 
-	return m >> bit_shift;
+	return static_cast<state_type>(m >> STYPE_BITS);
 }
 
-// For random numbers in a range [lower:upper)
+// The rejection threshold is only worked out once per fill. Each batch is
+// multiplied out without any branches, noting which elements fall below the
+// threshold, and those few are then redrawn together until they are all accepted.
 template<typename result_type, typename state_type>
-result_type Threaded_rands<result_type, state_type>::get_bounded_rand(const result_type lower, const result_type upper, const unsigned int thread_id)
+template<typename G>
+void Threaded_rands<result_type, state_type>::fill_range(G& g, result_type* first, result_type* last,
+														const result_type lower, const result_type upper)
 {
-	// If we're not doing [0-n)
-	result_type our_upper = upper - lower;
+	const state_type range = static_cast<state_type>(upper - lower);
 
-	// State type is the type returned from the generator
-	state_type x = get_rand(thread_id);
+	// An empty range, bounded_rand gives 0 for this
+	if(range == 0)
+	{
+		std::fill(first, last, lower);
+		return;
+	}
 
-	int_type m = static_cast<int_type>(x) * static_cast<int_type>(our_upper);
+	// Same as the t worked out in bounded_rand
+	const state_type threshold = static_cast<state_type>(-range) % range;
 
-	state_type l = static_cast<state_type>(m);
+	// Draw each batch up front if the generator has SIMD lanes or if the multiplies
+	// are 32x32 bits, which the compiler vectorises once they are in their own loop.
+	// A scalar 64-bit generator is quicker drawn from inside the loop.
+	constexpr bool buffered = has_bulk_fill<G>::value || STYPE_BITS == 32;
+
+	constexpr std::size_t batch_size = 256;
+	state_type raw[batch_size];
+	// Positions in the batch still to be accepted
+	std::size_t rejected[batch_size];
 
-	if (l < our_upper) 
+	while(first != last)
 	{
-	    state_type t = -our_upper;
-	    if (t >= our_upper) 
-	    {
-	        t -= our_upper;
-	        if (t >= our_upper) 
-	            t %= our_upper;
-	    }
-	    while (l < t) 
-	    {
-	        x = get_rand(thread_id);
-	        m = int_type(x) * int_type(our_upper);
-	        l = static_cast<state_type>(m);
-	    }
+		const std::size_t n = std::min<std::size_t>(batch_size, last - first);
+
+		if constexpr(buffered)
+			draw_raw(g, raw, n);
+
+		std::size_t n_rejected = 0;
+		for(std::size_t i = 0; i < n; i++)
+		{
+			state_type x;
+			if constexpr(buffered)
+				x = raw[i];
+			else
+				x = g.get_rand();
+
+			const int_type m = static_cast<int_type>(x) * static_cast<int_type>(range);
+
+			first[i] = static_cast<result_type>(lower + static_cast<state_type>(m >> STYPE_BITS));
+
+			rejected[n_rejected] = i;
+			n_rejected += (static_cast<state_type>(m) < threshold);
+		}
+
+		while(n_rejected > 0)
+		{
+			draw_raw(g, raw, n_rejected);
+
+			std::size_t n_left = 0;
+			for(std::size_t j = 0; j < n_rejected; j++)
+			{
+				const int_type m = static_cast<int_type>(raw[j]) * static_cast<int_type>(range);
+				const std::size_t i = rejected[j];
+
+				first[i] = static_cast<result_type>(lower + static_cast<state_type>(m >> STYPE_BITS));
+
+				rejected[n_left] = i;
+				n_left += (static_cast<state_type>(m) < threshold);
+			}
+
+			n_rejected = n_left;
+		}
+
+		first += n;
 	}
+}
 
-	// Add lower to get within the correct range
-	m += lower;
+// The bytes of each rand are copied straight into the output, so for ints a
+// 64-bit rand gives two uint32_t, four uint16_t or eight uint8_t. The rands of
+// generators with weak low bits are mixed first so no part of the output is of
+// lower quality. The last few bytes may only take part of a rand.
+template<typename result_type, typename state_type>
+template<typename G>
+void Threaded_rands<result_type, state_type>::fill_raw_bytes(G& g, unsigned char* out, const std::size_t n_bytes)
+{
+	constexpr bool mix = has_weak_low_bits<G>::value;
+
+	const std::size_t n_whole = n_bytes / sizeof(state_type);
+
+	if constexpr(has_bulk_fill<G>::value)
+	{
+		g.fill(simd::bytes_out<state_type, mix>{out}, n_whole);
+	}
+	else
+	{
+		// Go through a local batch, as the compiler has to assume writes
+		// through out could change the generator's state
+		constexpr std::size_t batch_size = 256;
+		state_type raw[batch_size];
+
+		for(std::size_t j = 0; j < n_whole; j += batch_size)
+		{
+			const std::size_t m = std::min(batch_size, n_whole - j);
+
+			draw_raw(g, raw, m);
+			if constexpr(mix)
+				for(std::size_t k = 0; k < m; k++)
+					raw[k] = simd::mix_low_bits(raw[k]);
+
+			std::memcpy(out + j * sizeof(state_type), raw, m * sizeof(state_type));
+		}
+	}
+
+	if(n_bytes % sizeof(state_type) != 0)
+	{
+		state_type x;
+		draw_raw(g, &x, 1);
+		if constexpr(mix)
+			x = simd::mix_low_bits(x);
+		std::memcpy(out + n_whole * sizeof(state_type), &x, n_bytes % sizeof(state_type));
+	}
+}
+
+// A long region from a generator with SIMD lanes is written with streaming stores,
+// which don't read in each cache line before overwriting it. These need 16-byte
+// alignment, a region that doesn't start on a 16-byte boundary is written with
+// ordinary stores. The bytes are the same either way, only how they are stored
+// changes, so the output never depends on the address of the region.
+template<typename result_type, typename state_type>
+template<typename G>
+void Threaded_rands<result_type, state_type>::fill_region(G& g, unsigned char* first, unsigned char* last)
+{
+	const std::size_t n = last - first;
+
+	if constexpr(has_bulk_fill<G>::value)
+	{
+		if(n >= stream_bytes && reinterpret_cast<std::uintptr_t>(first) % 16 == 0)
+		{
+			const std::size_t n_whole = n / sizeof(state_type);
+
+			g.fill(simd::bytes_out<state_type, has_weak_low_bits<G>::value, true>{first}, n_whole);
+			simd::stream_fence();
+
+			// Part of one more rand, as fill_raw_bytes would do
+			fill_raw_bytes(g, first + n_whole * sizeof(state_type), n % sizeof(state_type));
+
+			return;
+		}
+	}
+
+	fill_raw_bytes(g, first, n);
+}
+
+// p is taken as a 64-bit fixed point fraction, rounded down. Each word is then
+// worked out by comparing 64 uniform numbers, one per bit, against p one binary
+// digit at a time, see bernoulli_fill in simd_kernels.hpp. The raw words are
+// drawn in batches and any left over at the end are dropped.
+template<typename result_type, typename state_type>
+template<typename G>
+void Threaded_rands<result_type, state_type>::fill_bernoulli(G& g, std::uint64_t* first, std::uint64_t* last, const double p)
+{
+	if(!(p > 0) || p >= 1)
+	{
+		std::fill(first, last, (p >= 1) ? ~std::uint64_t(0) : 0);
+		return;
+	}
+
+	constexpr std::size_t batch_size = 64;
+	std::uint64_t raw[batch_size];
+	std::size_t used = batch_size;
+
+	auto next = [&]
+	{
+		if(used == batch_size)
+		{
+			fill_raw_bytes(g, reinterpret_cast<unsigned char*>(raw), sizeof(raw));
+			used = 0;
+		}
+
+		return raw[used++];
+	};
+
+	bernoulli_fill(next, first, last - first, static_cast<std::uint64_t>(p * 0x1p64));
+}
+
+// Generators with a bulk fill convert each vector of rands as it is generated.
+// A 64-bit kernel is run for half as many rands as floats, an odd last float
+// is taken from the low half of one more rand. The low 32 bits of xoroshiro128+
+// are weak so, as in fill_raw_bytes, its rands are mixed before they are split.
+template<typename result_type, typename state_type>
+template<typename G, typename Convert>
+void Threaded_rands<result_type, state_type>::fill_floats(G& g, float* first, float* last, const Convert& convert)
+{
+	constexpr bool mix = has_weak_low_bits<G>::value;
+
+	const std::size_t n = last - first;
+
+	auto next = [&g]
+	{
+		state_type x;
+		draw_raw(g, &x, 1);
+		if constexpr(mix)
+			x = simd::mix_low_bits(x);
+		return x;
+	};
+
+	if constexpr(has_bulk_fill<G>::value)
+	{
+		using out_type = simd::float_out<state_type, Convert, mix>;
+
+		g.fill(out_type{first, convert}, n / out_type::per_rand);
+
+		if(n % out_type::per_rand != 0)
+			first[n - 1] = convert(static_cast<std::uint32_t>(next()));
+
+		return;
+	}
+
+	std::size_t i = 0;
+
+	if constexpr(STYPE_BITS == 64)
+	{
+		for(; i + 2 <= n; i += 2)
+		{
+			const state_type x = next();
+			first[i] = convert(static_cast<std::uint32_t>(x));
+			first[i + 1] = convert(static_cast<std::uint32_t>(x >> 32));
+		}
+	}
+
+	for(; i < n; i++)
+		first[i] = convert(static_cast<std::uint32_t>(next()));
+}
+
+// For random numbers in a range [0:upper)
+template<typename result_type, typename state_type>
+result_type Threaded_rands<result_type, state_type>::get_bounded_rand(const result_type upper, const unsigned int thread_id)
+{
+	return visit_generator(thread_id, [&](auto& g){ return static_cast<result_type>(bounded_rand(g, upper)); });
+}
+
+// For random numbers in a range [lower:upper)
+template<typename result_type, typename state_type>
+result_type Threaded_rands<result_type, state_type>::get_bounded_rand(const result_type lower, const result_type upper, const unsigned int thread_id)
+{
+	// If we're not doing [0-n)
+	const state_type our_upper = static_cast<state_type>(upper - lower);
 
-	// Shift to get the type requested
-	return m >> bit_shift;
+	// Add lower to get within the correct range
+	return visit_generator(thread_id, [&](auto& g){ return static_cast<result_type>(lower + bounded_rand(g, our_upper)); });
 }
 
 // This is currently limited to positive 64-bit ints - should it be the full range of the generator and negatives?
 template<typename result_type, typename state_type>
 void Threaded_rands<result_type, state_type>::generate_range(std::vector<result_type>& vec, const unsigned int upper, const unsigned int thread_id)
 {
-	for(auto& i : vec)
-		i = get_bounded_rand(upper, thread_id);
+	visit_generator(thread_id, [&](auto& g){ fill_range(g, vec.data(), vec.data() + vec.size(), 0, upper); });
 }
 
 template<typename result_type, typename state_type>
 void Threaded_rands<result_type, state_type>::generate_range(std::vector<result_type>& vec, const unsigned int lower, const unsigned int upper, const unsigned int thread_id)
 {
-	for(auto& i : vec)
-		i = get_bounded_rand(lower, upper, thread_id);
+	visit_generator(thread_id, [&](auto& g){ fill_range(g, vec.data(), vec.data() + vec.size(), lower, upper); });
+}
+
+template<typename result_type, typename state_type>
+void Threaded_rands<result_type, state_type>::generate_range(result_type* data, const std::size_t n, const result_type lower, const result_type upper)
+{
+	parallel_fill(data, n, [=](auto& g, result_type* first, result_type* last){ fill_range(g, first, last, lower, upper); });
 }
 
 template<typename result_type, typename state_type>
 void Threaded_rands<result_type, state_type>::generate_range(std::vector<std::vector<result_type>>& vec, const unsigned int upper)
 {
-	#pragma omp parallel for num_threads(n_threads)
-	for(unsigned int i = 0; i < vec.size(); i++)
-	{
-		generate_range(vec[i], upper, i);
-	}
+	fill_rows(vec, [=](auto& g, result_type* first, result_type* last){ fill_range(g, first, last, 0, upper); });
 }
 
 template<typename result_type, typename state_type>
 void Threaded_rands<result_type, state_type>::generate_range(std::vector<std::vector<result_type>>& vec, 
 									const unsigned int lower, const unsigned int upper)
 {
-	#pragma omp parallel for num_threads(n_threads)
-	for(unsigned int i = 0; i < vec.size(); i++)
+	fill_rows(vec, [=](auto& g, result_type* first, result_type* last){ fill_range(g, first, last, lower, upper); });
+}
+
+template<typename result_type, typename state_type>
+std::unique_ptr<typename Threaded_rands<result_type, state_type>::gen_slot> 
+Threaded_rands<result_type, state_type>::make_slot(const generator_type sel, const unsigned int thread_id) const
+{
+	switch(sel)
 	{
-		generate_range(vec[i], lower, upper, i);
+		case generator_type::pcg_setseq:
+			return std::make_unique<gen_slot>(std::in_place_type<pcg_setseq<state_type>>, thread_id, master_seed);
+		case generator_type::xoro128:
+			return std::make_unique<gen_slot>(std::in_place_type<xoroshiro128<state_type>>, thread_id);
+		case generator_type::jsf:
+			return std::make_unique<gen_slot>(std::in_place_type<jsf<state_type>>, thread_id);
+		case generator_type::philox:
+			return std::make_unique<gen_slot>(std::in_place_type<philox<state_type>>, thread_id, master_seed);
+		case generator_type::threefry:
+			return std::make_unique<gen_slot>(std::in_place_type<threefry<state_type>>, thread_id, master_seed);
+		case generator_type::threefry13:
+			return std::make_unique<gen_slot>(std::in_place_type<threefry<state_type, 13>>, thread_id, master_seed);
+		case generator_type::xoshiro256pp:
+			return std::make_unique<gen_slot>(std::in_place_type<xoshiro256<state_type>>, thread_id, master_seed);
+		case generator_type::xoshiro256ss:
+			return std::make_unique<gen_slot>(std::in_place_type<xoshiro256<state_type, true>>, thread_id, master_seed);
+		case generator_type::sfc:
+			return std::make_unique<gen_slot>(std::in_place_type<sfc<state_type>>, thread_id, master_seed);
+		case generator_type::chacha:
+			return std::make_unique<gen_slot>(std::in_place_type<chacha<state_type>>, thread_id);
+		case generator_type::chacha12:
+			return std::make_unique<gen_slot>(std::in_place_type<chacha<state_type, 12>>, thread_id);
+		case generator_type::chacha8:
+			return std::make_unique<gen_slot>(std::in_place_type<chacha<state_type, 8>>, thread_id);
+		case generator_type::pcg:
+		default:
+			return std::make_unique<gen_slot>(std::in_place_type<pcg_unique<state_type>>, thread_id);
 	}
 }
 
-// These functions are available but currently unused
+// Chunks are roughly n / n_threads long. If the elements line up with the cache
+// lines each boundary after the first is moved up to the start of a cache line
+// so no two threads write to the same line.
+template<typename result_type, typename state_type>
+template<typename T>
+std::size_t Threaded_rands<result_type, state_type>::chunk_boundary(const T* data, const std::size_t n, const unsigned int k) const
+{
+	if(k == 0)
+		return 0;
+	if(k >= n_threads)
+		return n;
+
+	std::size_t boundary = (n / n_threads) * k + (n % n_threads) * k / n_threads;
+
+	const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(data);
+
+	if(cache_line % sizeof(T) == 0 && address % sizeof(T) == 0)
+	{
+		const std::size_t per_line = cache_line / sizeof(T);
+		// Elements before the first cache line boundary in the buffer
+		const std::size_t head = ((cache_line - address % cache_line) % cache_line) / sizeof(T);
+
+		if(boundary > head)
+			boundary = head + ((boundary - head + per_line - 1) / per_line) * per_line;
+		else
+			boundary = head;
+	}
+
+	return std::min(boundary, n);
+}
 
-// Detect the number of threads available on the machine using (if needed) multiple methods 
 template<typename result_type, typename state_type>
-unsigned int Threaded_rands<result_type, state_type>::get_thread_info(const int n_selected)
+template<typename T>
+std::pair<std::size_t, std::size_t> Threaded_rands<result_type, state_type>::first_share(const T* data, const std::size_t n, const unsigned int thread_id) const
 {
-	// How many to use
-	unsigned int n_utilise = 1;
-	// How many we have available
-	unsigned int n_hardware = std::thread::hardware_concurrency();
+	if(partition == partition_type::block)
+	{
+		// The same split worker_pool::run_tasks starts with
+		const std::size_t n_blocks = (n + block_size - 1) / block_size;
+		const std::size_t first = n_blocks * thread_id / n_threads * block_size;
+		const std::size_t last = n_blocks * (thread_id + 1) / n_threads * block_size;
 
-	// If the above doesn't work (it will return 0 on error) use a different method
-	if(n_hardware == 0)
-		n_hardware = backup_thread_count();
+		return {std::min(first, n), std::min(last, n)};
+	}
 
-	if(n_selected <= 0)
+	return {chunk_boundary(data, n, thread_id), chunk_boundary(data, n, thread_id + 1)};
+}
+
+template<typename result_type, typename state_type>
+template<typename T>
+numa_vector<T> Threaded_rands<result_type, state_type>::allocate(const std::size_t n)
+{
+	static_assert(std::is_trivial<T>::value, "Only buffers of trivial types can be allocated");
+
+	numa_vector<T> vec(n);
+
+	T* data = vec.data();
+
+	pool.run([&](const unsigned int thread_id)
 	{
-		std::cerr << "The number of selected threads is too low. The maximum available in hardware will be used.\n";
-		n_utilise = n_hardware;
+		const auto share = first_share(data, n, thread_id);
+		std::memset(static_cast<void*>(data + share.first), 0, (share.second - share.first) * sizeof(T));
+	});
+
+	return vec;
+}
+
+template<typename result_type, typename state_type>
+template<typename T, typename F>
+void Threaded_rands<result_type, state_type>::parallel_fill(T* data, const std::size_t n, F&& f)
+{
+	if(partition == partition_type::block)
+	{
+		const std::size_t n_blocks = (n + block_size - 1) / block_size;
+
+		pool.run_tasks(n_blocks, [&](const unsigned int, const std::size_t b)
+		{
+			with_block_generator(block_offset + b, [&](auto& g){ f(g, data + b * block_size, data + std::min(n, (b + 1) * block_size)); });
+		});
+
+		block_offset += n_blocks;
+
+		return;
 	}
-	else if(n_selected > n_hardware)
+
+	pool.run([&](const unsigned int w)
+	{
+		const auto share = first_share(data, n, w);
+
+		visit_generator(w, [&](auto& g){ f(g, data + share.first, data + share.second); });
+	});
+}
+
+template<typename result_type, typename state_type>
+template<typename Rows, typename F>
+void Threaded_rands<result_type, state_type>::fill_rows(Rows& rows, F&& f)
+{
+	if(partition == partition_type::block)
 	{
-		std::cerr << "Number of requested threads exceeds those available in hardware, using max available.\n";
-		n_utilise = n_hardware;
+		// The blocks of each row are numbered on from the blocks of the row before,
+		// row i holds blocks [row_start[i]:row_start[i+1])
+		std::vector<std::size_t> row_start(rows.size() + 1, 0);
+		for(std::size_t i = 0; i < rows.size(); i++)
+			row_start[i + 1] = row_start[i] + (rows[i].size() + block_size - 1) / block_size;
+
+		const std::size_t n_blocks = row_start.back();
+
+		pool.run_tasks(n_blocks, [&](const unsigned int, const std::size_t b)
+		{
+			const std::size_t i = std::upper_bound(row_start.begin(), row_start.end(), b) - row_start.begin() - 1;
+			const std::size_t offset = (b - row_start[i]) * block_size;
+
+			auto* data = rows[i].data();
+			with_block_generator(block_offset + b, [&](auto& g){ f(g, data + offset, data + std::min(rows[i].size(), offset + block_size)); });
+		});
+
+		block_offset += n_blocks;
+
+		return;
 	}
-	else
-		n_utilise = n_selected;
 
-	return n_utilise;
+	pool.run([&](const unsigned int thread_id)
+	{
+		for(std::size_t i = thread_id; i < rows.size(); i += n_threads)
+		{
+			auto* data = rows[i].data();
+			visit_generator(thread_id, [&](auto& g){ f(g, data, data + rows[i].size()); });
+		}
+	});
+}
+
+template<typename result_type, typename state_type>
+std::uint64_t Threaded_rands<result_type, state_type>::entropy_seed()
+{
+	std::random_device rd;
+
+	return std::uint64_t(rd()) << 32 | rd();
+}
+
+// Each worker allocates and seeds its own generator so the memory is first
+// touched by (and local to) the thread that will be using it. The generator
+// constructors aren't thread-safe so they take turns, but each still runs
+// on the worker that owns the generator.
+template<typename result_type, typename state_type>
+void Threaded_rands<result_type, state_type>::create_generators(const generator_type sel)
+{
+	selection = sel;
+	gen_vec.resize(n_threads);
+
+	std::mutex create_mutex;
+
+	pool.run([&](const unsigned int thread_id)
+	{
+		std::lock_guard<std::mutex> lock(create_mutex);
+		gen_vec[thread_id] = make_slot(sel, thread_id);
+	});
+}
+
+// Detect the number of threads available to this process using (if needed) multiple methods.
+// An explicit request for more threads than CPUs is honoured, as the output of the
+// seeded generators depends on the number of threads, but warned about once per process
+template<typename result_type, typename state_type>
+unsigned int Threaded_rands<result_type, state_type>::get_thread_info(const unsigned int n_selected)
+{
+	// How many we have available, the affinity mask and any cgroup CPU quota
+	unsigned int n_available = available_cpus();
+
+	// If the above doesn't work (it will return 0 on error) use a different method
+	if(n_available == 0)
+		n_available = std::max(1u, backup_thread_count());
+
+	if(n_selected == 0)
+		return n_available;
+
+	if(n_selected > n_available)
+		warn_oversubscribed(n_selected, n_available);
+
+	return n_selected;
 }
 
 // // If hardware_concurrency method fails fall back to this and detect the type of OS
@@ -0,0 +1,410 @@
+#ifndef TOPOLOGY_HPP
+#define TOPOLOGY_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+// ======================================
+// 				numa_topology
+// ======================================
+
+// The NUMA nodes of the machine and the CPUs belonging to each, read from sysfs
+// on Linux. Everywhere else (or if sysfs can't be read) all the CPUs are
+// treated as a single node.
+
+// Memory on Linux is placed on the node of the thread that first touches it, so
+// a worker pinned to a CPU on a node that allocates and writes its own memory
+// keeps that memory local.
+
+// Parse a kernel CPU list such as "0-3,8-11,16"
+inline std::vector<unsigned int> parse_cpu_list(const std::string& list)
+{
+	std::vector<unsigned int> cpus;
+
+	std::stringstream ss(list);
+	std::string range;
+
+	while(std::getline(ss, range, ','))
+	{
+		if(range.find_first_of("0123456789") == std::string::npos)
+			continue;
+
+		const std::size_t dash = range.find('-');
+
+		try
+		{
+			const unsigned int first = std::stoul(range.substr(0, dash));
+			const unsigned int last = (dash == std::string::npos) ? first : std::stoul(range.substr(dash + 1));
+
+			for(unsigned int cpu = first; cpu <= last; cpu++)
+				cpus.push_back(cpu);
+		}
+		catch(const std::exception&)
+		{
+			// Skip anything we can't make sense of
+		}
+	}
+
+	return cpus;
+}
+
+class numa_topology
+{
+protected:
+	// The CPUs on each node
+	std::vector<std::vector<unsigned int>> node_cpus;
+
+public:
+	// Read the topology of this machine
+	static numa_topology detect();
+
+	unsigned int n_nodes() const { return node_cpus.size(); }
+
+	const std::vector<unsigned int>& cpus(const unsigned int node) const { return node_cpus[node]; }
+
+	// The node a CPU belongs to, 0 if it isn't found
+	unsigned int node_of(const unsigned int cpu) const
+	{
+		for(unsigned int node = 0; node < node_cpus.size(); node++)
+			if(std::find(node_cpus[node].begin(), node_cpus[node].end(), cpu) != node_cpus[node].end())
+				return node;
+
+		return 0;
+	}
+
+	// The same topology with only the given CPUs, nodes left without any CPUs are dropped
+	numa_topology restrict_to(const std::vector<unsigned int>& allowed) const;
+
+	// CPUs for n workers, taking one from each node in turn so the workers
+	// (and the memory they touch) are spread evenly over the nodes
+	std::vector<unsigned int> spread(const unsigned int n) const;
+};
+
+inline numa_topology numa_topology::detect()
+{
+	numa_topology topology;
+
+#if defined(__linux__)
+	// Nodes may not be numbered contiguously so use the list of online nodes
+	std::ifstream online("/sys/devices/system/node/online");
+	std::string node_list;
+
+	if(online && std::getline(online, node_list))
+	{
+		for(const unsigned int node : parse_cpu_list(node_list))
+		{
+			std::ifstream cpu_file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+			std::string cpu_list;
+
+			if(cpu_file && std::getline(cpu_file, cpu_list))
+			{
+				std::vector<unsigned int> cpus = parse_cpu_list(cpu_list);
+
+				// Memory-only nodes don't have any CPUs to run workers on
+				if(!cpus.empty())
+					topology.node_cpus.push_back(std::move(cpus));
+			}
+		}
+	}
+#endif
+
+	if(topology.node_cpus.empty())
+	{
+		const unsigned int n_cpus = std::max(1u, std::thread::hardware_concurrency());
+
+		std::vector<unsigned int> cpus(n_cpus);
+		for(unsigned int cpu = 0; cpu < n_cpus; cpu++)
+			cpus[cpu] = cpu;
+
+		topology.node_cpus.push_back(std::move(cpus));
+	}
+
+	return topology;
+}
+
+inline numa_topology numa_topology::restrict_to(const std::vector<unsigned int>& allowed) const
+{
+	numa_topology topology;
+
+	for(const auto& cpus : node_cpus)
+	{
+		std::vector<unsigned int> kept;
+		for(const unsigned int cpu : cpus)
+			if(std::find(allowed.begin(), allowed.end(), cpu) != allowed.end())
+				kept.push_back(cpu);
+
+		if(!kept.empty())
+			topology.node_cpus.push_back(std::move(kept));
+	}
+
+	// Don't end up with nowhere to run
+	if(topology.node_cpus.empty())
+		return *this;
+
+	return topology;
+}
+
+inline std::vector<unsigned int> numa_topology::spread(const unsigned int n) const
+{
+	std::vector<unsigned int> result;
+	result.reserve(n);
+
+	std::size_t total = 0;
+	for(const auto& cpus : node_cpus)
+		total += cpus.size();
+
+	// Worker i goes on node i % n_nodes, wrapping around the CPUs of
+	// each node if there are more workers than CPUs
+	std::vector<std::size_t> next(node_cpus.size(), 0);
+
+	for(unsigned int i = 0; i < n; i++)
+	{
+		unsigned int node = i % node_cpus.size();
+
+		// Skip over nodes that have run out of CPUs while others still have some
+		if(i < total)
+			while(next[node] >= node_cpus[node].size())
+				node = (node + 1) % node_cpus.size();
+
+		result.push_back(node_cpus[node][next[node]++ % node_cpus[node].size()]);
+	}
+
+	return result;
+}
+
+// ======================================
+// 			  CPU availability
+// ======================================
+
+// In a container hardware_concurrency() reports every CPU on the host, whereas
+// the process may only be allowed to run on a few of them (its affinity mask)
+// or only be given a fraction of the machine's time (a cgroup CPU quota).
+
+// The CPUs this process is allowed to run on, empty if they can't be found
+inline std::vector<unsigned int> allowed_cpus()
+{
+	std::vector<unsigned int> cpus;
+
+#if defined(__linux__)
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+
+	if(sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0)
+	{
+		for(unsigned int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+			if(CPU_ISSET(cpu, &cpu_set))
+				cpus.push_back(cpu);
+
+		return cpus;
+	}
+#endif
+
+	const unsigned int n_cpus = std::thread::hardware_concurrency();
+	for(unsigned int cpu = 0; cpu < n_cpus; cpu++)
+		cpus.push_back(cpu);
+
+	return cpus;
+}
+
+// Read the first line of a file, false if it can't be read
+inline bool read_first_line(const std::string& path, std::string& line)
+{
+	std::ifstream file(path);
+
+	return file && std::getline(file, line) && !line.empty();
+}
+
+// The CPUs a quota and period (in microseconds) give, rounded up. 0 if there is no
+// limit, which is a quota of "max" for cgroup v2 or -1 for v1, or it can't be read
+inline unsigned int quota_cpus(const std::string& quota, const std::string& period)
+{
+	if(quota.empty() || quota == "max" || quota[0] == '-' || period.empty())
+		return 0;
+
+	try
+	{
+		const unsigned long long q = std::stoull(quota);
+		const unsigned long long p = std::stoull(period);
+
+		if(q > 0 && p > 0)
+			return std::max(1ull, (q + p - 1) / p);
+	}
+	catch(const std::exception&)
+	{
+		// Ignore a quota we can't read
+	}
+
+	return 0;
+}
+
+// The same for a line of cgroup v2's cpu.max, "max 100000" or "<quota> <period>"
+inline unsigned int cpu_max_cpus(const std::string& line)
+{
+	std::stringstream ss(line);
+	std::string quota, period;
+	ss >> quota >> period;
+
+	return quota_cpus(quota, period);
+}
+
+// The CPU quota of the cgroup at dir and its parents (the smallest is the one that
+// applies), rounded up to whole CPUs, 0 if there isn't one. The quota and period are
+// read from cpu.max for cgroup v2 or from cpu.cfs_quota_us and cpu.cfs_period_us for v1
+inline unsigned int cgroup_quota(const std::string& mount, std::string dir, const bool v2)
+{
+	unsigned int limit = 0;
+
+	while(true)
+	{
+		const std::string base = mount + (dir == "/" ? "" : dir);
+		unsigned int cpus = 0;
+
+		if(v2)
+		{
+			std::string line;
+			if(read_first_line(base + "/cpu.max", line))
+				cpus = cpu_max_cpus(line);
+		}
+		else
+		{
+			std::string quota, period;
+			read_first_line(base + "/cpu.cfs_quota_us", quota);
+			read_first_line(base + "/cpu.cfs_period_us", period);
+			cpus = quota_cpus(quota, period);
+		}
+
+		if(cpus > 0)
+			limit = (limit == 0) ? cpus : std::min(limit, cpus);
+
+		if(dir.empty() || dir == "/")
+			break;
+
+		const std::size_t slash = dir.find_last_of('/');
+		dir = (slash == 0 || slash == std::string::npos) ? "/" : dir.substr(0, slash);
+	}
+
+	return limit;
+}
+
+// The CPU quota given to this process by its cgroup, rounded up, 0 if there isn't one
+inline unsigned int cgroup_cpu_limit()
+{
+	unsigned int limit = 0;
+
+#if defined(__linux__)
+	std::ifstream cgroup_file("/proc/self/cgroup");
+	std::string line;
+
+	// Each line is hierarchy-id:controllers:path, v2 has no controllers listed
+	while(std::getline(cgroup_file, line))
+	{
+		const std::size_t first = line.find(':');
+		const std::size_t second = (first == std::string::npos) ? first : line.find(':', first + 1);
+
+		if(second == std::string::npos)
+			continue;
+
+		const std::string controllers = line.substr(first + 1, second - first - 1);
+		const std::string path = line.substr(second + 1);
+
+		std::vector<std::pair<std::string, bool>> mounts;
+
+		if(controllers.empty())
+		{
+			mounts.emplace_back("/sys/fs/cgroup", true);
+			mounts.emplace_back("/sys/fs/cgroup/unified", true);
+		}
+		else if(("," + controllers + ",").find(",cpu,") != std::string::npos)
+		{
+			mounts.emplace_back("/sys/fs/cgroup/" + controllers, false);
+			mounts.emplace_back("/sys/fs/cgroup/cpu", false);
+		}
+
+		for(const auto& mount : mounts)
+		{
+			// Inside a container the cgroup is usually mounted as the root
+			// so check there as well as at the full path
+			for(const std::string& dir : {path, std::string("/")})
+			{
+				const unsigned int quota = cgroup_quota(mount.first, dir, mount.second);
+
+				if(quota > 0)
+					limit = (limit == 0) ? quota : std::min(limit, quota);
+			}
+		}
+	}
+#endif
+
+	return limit;
+}
+
+// The number of CPUs this process can make use of, the smaller of the number it
+// is allowed to run on and its cgroup quota, 0 if this can't be found
+inline unsigned int available_cpus()
+{
+	unsigned int n_cpus = allowed_cpus().size();
+
+	const unsigned int quota = cgroup_cpu_limit();
+
+	if(quota > 0 && (n_cpus == 0 || quota < n_cpus))
+		n_cpus = quota;
+
+	return n_cpus;
+}
+
+// ======================================
+// 			untouched_allocator
+// ======================================
+
+// An allocator for page-aligned memory that leaves trivial elements uninitialised,
+// so resizing a vector doesn't write to (and place) its pages on the calling thread.
+// The pages are placed by whichever thread writes to them first.
+
+template<typename T>
+class untouched_allocator
+{
+public:
+	using value_type = T;
+
+	static constexpr std::size_t page_size = 4096;
+
+	untouched_allocator() = default;
+
+	template<typename U>
+	untouched_allocator(const untouched_allocator<U>&) {}
+
+	T* allocate(const std::size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(page_size))); }
+
+	void deallocate(T* p, const std::size_t) { ::operator delete(p, std::align_val_t(page_size)); }
+
+	// Default rather than value initialise
+	template<typename U>
+	void construct(U* p) { ::new(static_cast<void*>(p)) U; }
+
+	template<typename U, typename... Args>
+	void construct(U* p, Args&&... args) { ::new(static_cast<void*>(p)) U(std::forward<Args>(args)...); }
+};
+
+template<typename T, typename U>
+bool operator==(const untouched_allocator<T>&, const untouched_allocator<U>&) { return true; }
+
+template<typename T, typename U>
+bool operator!=(const untouched_allocator<T>&, const untouched_allocator<U>&) { return false; }
+
+// A vector whose pages are placed by the threads that first write to it
+template<typename T>
+using numa_vector = std::vector<T, untouched_allocator<T>>;
+
+#endif
@@ -0,0 +1,338 @@
+#ifndef WORKER_POOL_HPP
+#define WORKER_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// ======================================
+// 				worker_pool
+// ======================================
+
+// A fixed set of worker threads that live as long as the pool. Each worker is
+// pinned to a single CPU so anything it touches (its generator, its part of an
+// output buffer) stays in that core's caches between calls.
+
+// A job is run on every worker at once with run(f), which calls f(worker_id) on
+// each worker and returns once they have all finished. Workers spin for a short
+// while after finishing a job before going to sleep so back to back calls don't
+// pay for a full wake up.
+
+// run_tasks(n, f) shares out n small tasks between the workers. Each worker starts
+// with a contiguous run of tasks and once it runs out steals half of what is
+// left from another worker, so a few slow tasks don't hold up the whole job.
+
+// A pool with a single worker doesn't start a thread, jobs are run on the caller.
+
+class worker_pool
+{
+protected:
+	// Roughly how many times to check for new work (or for the workers to
+	// finish) before falling back to sleeping on a condition variable
+	static constexpr unsigned int spin_count = 1 << 14;
+
+	unsigned int n_workers = 1;
+
+	std::vector<std::thread> workers;
+
+	// The job currently being run
+	void (*job_fn)(void*, unsigned int) = nullptr;
+	void* job_data = nullptr;
+
+	// Bumped each time a new job is posted
+	std::atomic<std::uint64_t> epoch{0};
+	// Workers still running the current job
+	std::atomic<unsigned int> remaining{0};
+
+	std::atomic<bool> stop{false};
+
+	// For sleeping workers and a sleeping caller
+	std::mutex mutex;
+	std::condition_variable wake_workers;
+	std::condition_variable wake_caller;
+	std::atomic<unsigned int> workers_sleeping{0};
+	std::atomic<bool> caller_sleeping{false};
+
+	// The first exception thrown by a job, rethrown on the caller
+	std::exception_ptr job_error;
+
+	// The tasks [front:back) still to be run by a worker, packed into a single word
+	// so the owner and thieves can both update it with a compare and swap
+	struct alignas(128) task_queue
+	{
+		std::atomic<std::uint64_t> range{0};
+	};
+
+	std::unique_ptr<task_queue[]> queues;
+
+	static std::uint64_t pack(const std::uint64_t front, const std::uint64_t back) { return front << 32 | back; }
+	static std::uint64_t front(const std::uint64_t range) { return range >> 32; }
+	static std::uint64_t back(const std::uint64_t range) { return range & 0xffffffff; }
+
+	// Take the task at the front of a worker's own queue
+	bool pop_task(const unsigned int worker_id, std::uint64_t& task);
+
+	// Take the back half of another worker's queue, the first of the stolen
+	// tasks is returned and the rest become this worker's queue
+	bool steal_task(const unsigned int worker_id, std::uint64_t& task);
+
+	// Back off while spinning, every so often yield in case the
+	// thread we're waiting on is sharing this CPU
+	static inline void cpu_relax(const unsigned int spins)
+	{
+		if(spins % 64 == 63)
+		{
+			std::this_thread::yield();
+			return;
+		}
+	#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+	#endif
+	}
+
+	// Pin the calling thread to a single CPU, failures are ignored as
+	// the CPU may not be available to this process
+	static void pin_to_cpu(const unsigned int cpu)
+	{
+	#if defined(__linux__)
+		if(cpu >= CPU_SETSIZE)
+			return;
+
+		cpu_set_t cpu_set;
+		CPU_ZERO(&cpu_set);
+		CPU_SET(cpu, &cpu_set);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+	#else
+		(void)cpu;
+	#endif
+	}
+
+	void worker_loop(const unsigned int worker_id, const unsigned int cpu);
+
+	void run_job(const unsigned int worker_id);
+
+public:
+	// Start n workers, worker i is pinned to cpus[i] if given or to CPU i otherwise
+	explicit worker_pool(const unsigned int n, const std::vector<unsigned int>& cpus = {});
+
+	~worker_pool();
+
+	worker_pool(const worker_pool&) = delete;
+	worker_pool& operator=(const worker_pool&) = delete;
+
+	unsigned int size() const { return n_workers; }
+
+	// Run f(worker_id) on each worker and wait for them all to finish
+	template<typename F>
+	void run(F&& f);
+
+	// Run f(worker_id, task) for each task in [0:n_tasks) and wait for them all to finish
+	template<typename F>
+	void run_tasks(const std::size_t n_tasks, F&& f);
+};
+
+inline worker_pool::worker_pool(const unsigned int n, const std::vector<unsigned int>& cpus) 
+	: n_workers{std::max(1u, n)}, queues{new task_queue[std::max(1u, n)]}
+{
+	if(n_workers == 1)
+		return;
+
+	const unsigned int n_cpus = std::max(1u, std::thread::hardware_concurrency());
+
+	workers.reserve(n_workers);
+
+	for(unsigned int i = 0; i < n_workers; i++)
+	{
+		const unsigned int cpu = (i < cpus.size()) ? cpus[i] : i % n_cpus;
+		workers.emplace_back([this, i, cpu]{ worker_loop(i, cpu); });
+	}
+}
+
+inline worker_pool::~worker_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop.store(true);
+	}
+	wake_workers.notify_all();
+
+	for(auto& w : workers)
+		w.join();
+}
+
+inline void worker_pool::run_job(const unsigned int worker_id)
+{
+	try
+	{
+		job_fn(job_data, worker_id);
+	}
+	catch(...)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if(!job_error)
+			job_error = std::current_exception();
+	}
+
+	// The last worker to finish wakes the caller if it has gone to sleep
+	if(remaining.fetch_sub(1) == 1 && caller_sleeping.load())
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		wake_caller.notify_one();
+	}
+}
+
+inline void worker_pool::worker_loop(const unsigned int worker_id, const unsigned int cpu)
+{
+	pin_to_cpu(cpu);
+
+	std::uint64_t seen = 0;
+
+	while(true)
+	{
+		// Spin for a while in case another job follows closely
+		unsigned int spins = 0;
+		while(epoch.load(std::memory_order_acquire) == seen && !stop.load(std::memory_order_relaxed) && spins < spin_count)
+		{
+			cpu_relax(spins);
+			spins++;
+		}
+
+		if(epoch.load() == seen && !stop.load())
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			workers_sleeping.fetch_add(1);
+			wake_workers.wait(lock, [&]{ return epoch.load() != seen || stop.load(); });
+			workers_sleeping.fetch_sub(1);
+		}
+
+		if(stop.load())
+			return;
+
+		seen = epoch.load(std::memory_order_acquire);
+
+		run_job(worker_id);
+	}
+}
+
+template<typename F>
+void worker_pool::run(F&& f)
+{
+	if(workers.empty())
+	{
+		f(0u);
+		return;
+	}
+
+	job_data = static_cast<void*>(&f);
+	job_fn = [](void* data, const unsigned int worker_id){ (*static_cast<typename std::remove_reference<F>::type*>(data))(worker_id); };
+	job_error = nullptr;
+
+	remaining.store(n_workers);
+
+	// Post the job, only take the lock if a worker may be asleep
+	epoch.fetch_add(1);
+	if(workers_sleeping.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		wake_workers.notify_all();
+	}
+
+	unsigned int spins = 0;
+	while(remaining.load(std::memory_order_acquire) > 0 && spins < spin_count)
+	{
+		cpu_relax(spins);
+		spins++;
+	}
+
+	if(remaining.load() > 0)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		caller_sleeping.store(true);
+		wake_caller.wait(lock, [&]{ return remaining.load() == 0; });
+		caller_sleeping.store(false);
+	}
+
+	if(job_error)
+		std::rethrow_exception(job_error);
+}
+
+inline bool worker_pool::pop_task(const unsigned int worker_id, std::uint64_t& task)
+{
+	std::atomic<std::uint64_t>& range = queues[worker_id].range;
+
+	std::uint64_t r = range.load();
+	while(front(r) < back(r))
+	{
+		if(range.compare_exchange_weak(r, pack(front(r) + 1, back(r))))
+		{
+			task = front(r);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+inline bool worker_pool::steal_task(const unsigned int worker_id, std::uint64_t& task)
+{
+	for(unsigned int i = 1; i < n_workers; i++)
+	{
+		std::atomic<std::uint64_t>& victim = queues[(worker_id + i) % n_workers].range;
+
+		std::uint64_t r = victim.load();
+		while(front(r) < back(r))
+		{
+			// The victim keeps [front:mid) and we take [mid:back)
+			const std::uint64_t mid = front(r) + (back(r) - front(r)) / 2;
+
+			if(victim.compare_exchange_weak(r, pack(front(r), mid)))
+			{
+				task = mid;
+				// Our own queue is empty so no one else will be updating it
+				queues[worker_id].range.store(pack(mid + 1, back(r)));
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+// Tasks are only ever moved between queues, never added, so once a worker has
+// found every queue empty the remaining tasks all belong to workers that will run them
+template<typename F>
+void worker_pool::run_tasks(const std::size_t n_tasks, F&& f)
+{
+	// Task numbers have to fit in half of the packed range
+	constexpr std::size_t max_tasks = 0xffffffff;
+
+	for(std::size_t base = 0; base < n_tasks; base += max_tasks)
+	{
+		const std::uint64_t n = std::min(n_tasks - base, max_tasks);
+
+		for(unsigned int w = 0; w < n_workers; w++)
+			queues[w].range.store(pack(n * w / n_workers, n * (w + 1) / n_workers));
+
+		run([&](const unsigned int worker_id)
+		{
+			std::uint64_t task = 0;
+
+			while(pop_task(worker_id, task) || steal_task(worker_id, task))
+				f(worker_id, static_cast<std::size_t>(base + task));
+		});
+	}
+}
+
+#endif
@@ -0,0 +1,1668 @@
+#include "../include/threaded_rands.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Known answers for the generators and their SIMD kernels, checks that the bulk
+// fills agree with get_rand() and that the reproducible generators give the
+// same output for any number of threads.
+
+// The kernels run at the level picked by THREADED_RANDS_SIMD, make test runs
+// this once at each level. With --digest it only prints a hash of a set of
+// seeded fills, which make test compares across the levels.
+
+static unsigned int n_failed = 0;
+
+static void check(const bool ok, const std::string& name)
+{
+	if(!ok)
+	{
+		std::printf("FAIL %s\n", name.c_str());
+		n_failed++;
+	}
+}
+
+template<typename T>
+static bool equal(const T* got, const T* expected, const std::size_t n)
+{
+	return std::memcmp(got, expected, n * sizeof(T)) == 0;
+}
+
+// ======================================
+// 		  SIMD lanes against scalar
+// ======================================
+
+// Each lane of a kernel is started from the state of its own scalar generator.
+// Element i of every fill has to be the next rand of scalar generator i % L, with a
+// partial last step still stepping every lane and dropping the values left over
+template<std::size_t L, typename T, typename Fill, typename Next>
+static bool lanes_match(Fill&& fill, Next&& next)
+{
+	bool ok = true;
+
+	for(const std::size_t n : {3 * L + 5, 2 * L, std::size_t(1), 5 * L - 1})
+	{
+		std::vector<T> out(n);
+		fill(out.data(), n);
+
+		for(std::size_t i = 0; i < (n + L - 1) / L * L; i++)
+		{
+			const T x = next(i % L);
+			ok = ok && (i >= n || out[i] == x);
+		}
+	}
+
+	return ok;
+}
+
+// Scalar generators that can hand their state to a lane
+struct xoro_test : xoroshiro128<std::uint64_t>
+{
+	explicit xoro_test(const std::uint64_t stream) : xoroshiro128(substream(99, stream)) {}
+
+	void to_lane(xoro128_lanes& lanes, const std::size_t l) const
+	{
+		lanes.s0[l] = seed_array[0];
+		lanes.s1[l] = seed_array[1];
+	}
+};
+
+struct jsf_test : jsf<std::uint64_t>
+{
+	explicit jsf_test(const std::uint64_t stream) : jsf(substream(99, stream)) {}
+
+	void to_lane(jsf_lanes& lanes, const std::size_t l) const
+	{
+		lanes.a[l] = a_;
+		lanes.b[l] = b_;
+		lanes.c[l] = c_;
+		lanes.d[l] = d_;
+	}
+};
+
+struct pcg32_test : pcg32
+{
+	using pcg32::pcg32;
+
+	void to_lane(pcg32_lanes& lanes, const std::size_t l) const
+	{
+		lanes.state[l] = state_;
+		lanes.inc[l] = increment();
+	}
+};
+
+template<bool StarStar>
+struct xoshiro_lane_test : xoshiro256<std::uint64_t, StarStar>
+{
+	explicit xoshiro_lane_test(const std::uint64_t stream) : xoshiro256<std::uint64_t, StarStar>(xoshiro256<std::uint64_t, StarStar>::substream(99, stream)) {}
+
+	void to_lane(xoshiro256_lanes& lanes, const std::size_t l) const
+	{
+		lanes.s0[l] = this->seed_array[0];
+		lanes.s1[l] = this->seed_array[1];
+		lanes.s2[l] = this->seed_array[2];
+		lanes.s3[l] = this->seed_array[3];
+	}
+};
+
+struct sfc_lane_test : sfc<std::uint64_t>
+{
+	explicit sfc_lane_test(const std::uint64_t stream) : sfc(substream(99, stream)) {}
+
+	void to_lane(sfc64_lanes& lanes, const std::size_t l) const
+	{
+		lanes.a[l] = a_;
+		lanes.b[l] = b_;
+		lanes.c[l] = c_;
+		lanes.counter[l] = counter_;
+	}
+};
+
+// Start L lanes from L scalar generators made by make(l) and check the kernel run by fill
+template<typename Lanes, std::size_t L, typename T, typename Make, typename Fill>
+static void test_lanes(const std::string& name, Make&& make, Fill&& fill)
+{
+	Lanes lanes;
+	std::vector<decltype(make(0))> scalar;
+
+	for(std::size_t l = 0; l < L; l++)
+	{
+		scalar.push_back(make(l));
+		scalar.back().to_lane(lanes, l);
+	}
+
+	const bool ok = lanes_match<L, T>([&](T* out, const std::size_t n){ fill(lanes, out, n); },
+									  [&](const std::size_t l){ return static_cast<T>(scalar[l]()); });
+
+	check(ok, name + " kernel matches the scalar generator lane by lane");
+}
+
+static void test_kernels_against_scalar()
+{
+	using simd::n_lanes;
+	typedef simd::int_out<std::uint64_t> out64;
+
+	test_lanes<xoro128_lanes, n_lanes, std::uint64_t>("xoroshiro128+", [](const std::size_t l){ return xoro_test(l); },
+		[](xoro128_lanes& lanes, std::uint64_t* out, const std::size_t n){ xoro128_fill(lanes, out64{out}, n); });
+
+	test_lanes<jsf_lanes, n_lanes, std::uint64_t>("jsf64", [](const std::size_t l){ return jsf_test(l); },
+		[](jsf_lanes& lanes, std::uint64_t* out, const std::size_t n){ jsf_fill(lanes, out64{out}, n); });
+
+	test_lanes<pcg32_lanes, pcg32_lanes::n_lanes, std::uint32_t>("pcg32", [](const std::size_t l){ return pcg32_test(1000 + l, 7 * l); },
+		[](pcg32_lanes& lanes, std::uint32_t* out, const std::size_t n){ pcg32_fill(lanes, simd::int_out<std::uint32_t>{out}, n); });
+
+	test_lanes<xoshiro256_lanes, n_lanes, std::uint64_t>("xoshiro256++", [](const std::size_t l){ return xoshiro_lane_test<false>(l); },
+		[](xoshiro256_lanes& lanes, std::uint64_t* out, const std::size_t n){ xoshiro256_fill<false>(lanes, out64{out}, n); });
+
+	test_lanes<xoshiro256_lanes, n_lanes, std::uint64_t>("xoshiro256**", [](const std::size_t l){ return xoshiro_lane_test<true>(l); },
+		[](xoshiro256_lanes& lanes, std::uint64_t* out, const std::size_t n){ xoshiro256_fill<true>(lanes, out64{out}, n); });
+
+	test_lanes<sfc64_lanes, n_lanes, std::uint64_t>("sfc64", [](const std::size_t l){ return sfc_lane_test(l); },
+		[](sfc64_lanes& lanes, std::uint64_t* out, const std::size_t n){ sfc64_fill(lanes, out64{out}, n); });
+}
+
+// ======================================
+// 			  Fused doubles
+// ======================================
+
+// The doubles a bulk fill converts in the kernel are exactly double_conv of the
+// ints the same fill would give
+template<typename T>
+static void test_fused_doubles(const generator_type sel)
+{
+	const std::string name = std::to_string(8 * sizeof(T)) + "-bit generator " + std::to_string(static_cast<int>(sel));
+
+	Threaded_rands<T, T> ints_rands(2, sel, 31);
+	Threaded_rands<T, T> doubles_rands(2, sel, 31);
+	ints_rands.set_partition(partition_type::block, 1000);
+	doubles_rands.set_partition(partition_type::block, 1000);
+
+	std::vector<T> ints(4099);
+	std::vector<double> doubles(ints.size());
+	ints_rands.generate(ints.data(), ints.size());
+	doubles_rands.generate_doubles(doubles.data(), doubles.size());
+
+	bool ok = true;
+	for(std::size_t i = 0; i < ints.size(); i++)
+		ok = ok && doubles[i] == Threaded_rands<T, T>::double_conv(ints[i]);
+	check(ok, name + " fused doubles match double_conv");
+}
+
+// The conversion at the edges of the range, where the two halves have to be put
+// back together exactly
+static void test_to_double()
+{
+	const std::uint64_t edges[simd::n_lanes] = {0, 1, 0x7ff, 0x800, ~0ull, 1ull << 63, (1ull << 63) - 1, 0x123456789abcdef0};
+	const std::uint64_t edges32[simd::n_lanes] = {0, 1, 0x1ff, 0x200, 0xffffffff, 0x80000000, 0x7fffffff, 0x9abcdef0};
+
+	simd::u64x8 v;
+	simd::f64x8 d;
+	double out[simd::n_lanes];
+
+	simd::load(v, edges);
+	simd::to_double(d, v, 11, 0x1p-53);
+	std::memcpy(out, &d, sizeof(out));
+
+	bool ok = true;
+	for(std::size_t l = 0; l < simd::n_lanes; l++)
+		ok = ok && out[l] == Threaded_rands<std::uint64_t, std::uint64_t>::double_conv(edges[l]);
+	check(ok, "to_double at the edges of 64-bit rands");
+
+	simd::load(v, edges32);
+	simd::to_double(d, v, 9, 0x1p-23);
+	std::memcpy(out, &d, sizeof(out));
+
+	ok = true;
+	for(std::size_t l = 0; l < simd::n_lanes; l++)
+		ok = ok && out[l] == Threaded_rands<std::uint32_t, std::uint32_t>::double_conv(static_cast<std::uint32_t>(edges32[l]));
+	check(ok, "to_double at the edges of 32-bit rands");
+}
+
+static void test_doubles()
+{
+	test_to_double();
+
+	for(const generator_type sel : {generator_type::xoro128, generator_type::jsf, generator_type::pcg_setseq, generator_type::philox,
+									generator_type::threefry, generator_type::xoshiro256pp, generator_type::sfc})
+	{
+		test_fused_doubles<std::uint64_t>(sel);
+		test_fused_doubles<std::uint32_t>(sel);
+	}
+}
+
+// ======================================
+// 			   Bounded ranges
+// ======================================
+
+// Whether each of counts is within 6 standard deviations of a uniform share of n
+static bool uniform_counts(const std::vector<std::size_t>& counts, const std::size_t n)
+{
+	const double p = 1.0 / counts.size();
+	const double sd = std::sqrt(n * p * (1 - p));
+
+	bool ok = true;
+	for(const std::size_t c : counts)
+		ok = ok && std::abs(static_cast<double>(c) - n * p) < 6 * sd;
+
+	return ok;
+}
+
+// Fill with [lower:upper) and check every value is in range and falls evenly into
+// n_bins bins of width bin_width from lower, and into n_residues classes mod n_residues.
+// Without the rejections the multiply maps 2 rands onto every third value of [0:3*2^62)
+// and 1 onto the others, which the bins miss but the residues don't. The wide ranges
+// reject up to half the rands, so most batches have rejected elements to redraw
+template<typename T>
+static void test_range(const generator_type sel, const T lower, const T upper, const T bin_width, const std::size_t n_bins,
+					   const std::size_t n_residues, const std::string& name)
+{
+	Threaded_rands<T, T> t(1, sel, 11);
+
+	std::vector<T> out(300000);
+	t.generate_range(out.data(), out.size(), lower, upper);
+
+	bool in_range = true;
+	std::vector<std::size_t> counts(n_bins, 0);
+	std::vector<std::size_t> residues(n_residues, 0);
+	for(const T x : out)
+	{
+		in_range = in_range && x >= lower && x < upper;
+		if(x >= lower && x < upper)
+		{
+			counts[std::min<std::size_t>((x - lower) / bin_width, n_bins - 1)]++;
+			residues[(x - lower) % n_residues]++;
+		}
+	}
+
+	const std::string full_name = name + " with generator " + std::to_string(static_cast<int>(sel));
+	check(in_range, full_name + " in range");
+	check(uniform_counts(counts, out.size()), full_name + " evenly spread");
+	check(uniform_counts(residues, out.size()), full_name + " evenly spread over residues");
+}
+
+static void test_ranges()
+{
+	const std::uint64_t two_62 = std::uint64_t(1) << 62;
+	const std::uint64_t two_63 = std::uint64_t(1) << 63;
+
+	// pcg_setseq draws inside the loop, the others buffer each batch from their lanes
+	for(const generator_type sel : {generator_type::pcg_setseq, generator_type::xoshiro256pp, generator_type::philox})
+	{
+		// A quarter of the rands are rejected
+		test_range<std::uint64_t>(sel, 0, 3 * two_62, two_62, 3, 3, "range [0:3*2^62)");
+		// Just under half are rejected, 2^63 itself is counted in the upper bin
+		test_range<std::uint64_t>(sel, 0, two_63 + 1, two_62, 2, 2, "range [0:2^63]");
+		test_range<std::uint64_t>(sel, two_63 - 5, two_63 + 5, 1, 10, 2, "range around 2^63");
+		test_range<std::uint64_t>(sel, ~std::uint64_t(0) - 7, ~std::uint64_t(0), 1, 7, 7, "range at the top");
+		test_range<std::uint64_t>(sel, 1000, 1007, 1, 7, 7, "range [1000:1007)");
+		test_range<std::uint32_t>(sel, 0, 3u << 30, 1u << 30, 3, 3, "32-bit range [0:3*2^30)");
+		test_range<std::uint32_t>(sel, (1u << 31) - 3, (1u << 31) + 3, 1, 6, 3, "32-bit range around 2^31");
+	}
+
+	// An empty range fills with lower
+	Threaded_rands<std::uint64_t, std::uint64_t> t(1, generator_type::sfc, 11);
+	std::vector<std::uint64_t> out(100, 1);
+	t.generate_range(out.data(), out.size(), two_63, two_63);
+	check(std::count(out.begin(), out.end(), two_63) == 100, "empty range fills with lower");
+
+	// The batches and their redraws are the same whichever thread fills each block
+	std::vector<std::uint64_t> first;
+	for(unsigned int n_threads = 1; n_threads <= 3; n_threads++)
+	{
+		Threaded_rands<std::uint64_t, std::uint64_t> blocks(n_threads, generator_type::xoshiro256pp, 11);
+		blocks.set_partition(partition_type::block, 777);
+
+		std::vector<std::uint64_t> range_out(10000);
+		blocks.generate_range(range_out.data(), range_out.size(), 0, two_63 + 1);
+
+		if(n_threads == 1)
+			first = range_out;
+		else
+			check(range_out == first, "block partitioned range with " + std::to_string(n_threads) + " threads");
+	}
+}
+
+// ======================================
+// 			   Narrow ints
+// ======================================
+
+// Element j of a fill of ints narrower than the state is part j % per of rand j / per,
+// taken from the low bits up, and a fill that ends part way through a rand takes the
+// start of one more. expected holds the rands of an identically seeded generator
+template<typename T, typename S>
+static bool split_matches(const std::vector<T>& got, const std::vector<S>& expected)
+{
+	constexpr std::size_t per = sizeof(S) / sizeof(T);
+
+	bool ok = got.size() <= expected.size() * per;
+	for(std::size_t j = 0; ok && j < got.size(); j++)
+		ok = got[j] == static_cast<T>(expected[j / per] >> (8 * sizeof(T) * (j % per)));
+
+	return ok;
+}
+
+// Fill T narrower than the state S with a length that stops part way through a rand,
+// against a fill of the whole rands followed by a fill of one more
+template<typename T, typename S>
+static void test_split(const generator_type sel)
+{
+	constexpr std::size_t per = sizeof(S) / sizeof(T);
+	const std::size_t n_whole = 1001;
+
+	Threaded_rands<S, S> t(1, sel, 5);
+	std::vector<T> got(n_whole * per + per - 1);
+	t.generate(got);
+
+	Threaded_rands<S, S> ref(1, sel, 5);
+	std::vector<S> expected(n_whole);
+	ref.generate(expected);
+	std::vector<S> tail(1);
+	ref.generate(tail);
+	expected.push_back(tail[0]);
+
+	check(split_matches(got, expected), std::to_string(8 * sizeof(T)) + "-bit ints from " + std::to_string(8 * sizeof(S)) +
+										"-bit rands with generator " + std::to_string(static_cast<int>(sel)));
+}
+
+// The rands of xoroshiro128+ are put through mix_low_bits before they are split
+template<typename T, typename S>
+static void test_mixed_split()
+{
+	constexpr std::size_t per = sizeof(S) / sizeof(T);
+	const std::size_t n_whole = 1001;
+	const std::uint64_t first_block = std::uint64_t(1) << 63;
+
+	Threaded_rands<S, S> t(1, generator_type::xoro128, 7);
+	t.set_partition(partition_type::block, 1 << 16);
+
+	std::vector<T> got(n_whole * per + per - 1);
+	t.generate(got.data(), got.size());
+
+	auto g = xoroshiro128<S>::substream(7, first_block);
+	std::vector<S> expected(n_whole + 1);
+	if constexpr(has_bulk_fill<decltype(g)>::value)
+	{
+		g.fill(simd::int_out<S>{expected.data()}, n_whole);
+		g.fill(simd::int_out<S>{expected.data() + n_whole}, 1);
+	}
+	else
+	{
+		for(S& x : expected)
+			x = g.get_rand();
+	}
+	for(S& x : expected)
+		x = simd::mix_low_bits(x);
+
+	check(split_matches(got, expected), std::to_string(8 * sizeof(T)) + "-bit ints from " + std::to_string(8 * sizeof(S)) +
+										"-bit xoroshiro128+ rands are mixed");
+}
+
+static void test_narrow_ints()
+{
+	for(const generator_type sel : {generator_type::pcg_setseq, generator_type::philox, generator_type::threefry,
+									generator_type::xoshiro256pp, generator_type::sfc})
+	{
+		test_split<std::uint32_t, std::uint64_t>(sel);
+		test_split<std::uint16_t, std::uint64_t>(sel);
+		test_split<std::uint8_t, std::uint64_t>(sel);
+	}
+
+	for(const generator_type sel : {generator_type::pcg_setseq, generator_type::philox, generator_type::xoshiro256pp,
+									generator_type::sfc})
+	{
+		test_split<std::uint16_t, std::uint32_t>(sel);
+		test_split<std::uint8_t, std::uint32_t>(sel);
+	}
+
+	test_mixed_split<std::uint32_t, std::uint64_t>();
+	test_mixed_split<std::uint16_t, std::uint64_t>();
+	test_mixed_split<std::uint16_t, std::uint32_t>();
+
+	// The blocks count narrow ints, so a block-partitioned fill of them is the same
+	// for any number of threads
+	std::vector<std::uint16_t> first;
+	for(unsigned int n_threads = 1; n_threads <= 3; n_threads++)
+	{
+		Threaded_rands<std::uint64_t, std::uint64_t> t(n_threads, generator_type::sfc, 5);
+		t.set_partition(partition_type::block, 999);
+
+		std::vector<std::uint16_t> out(10003);
+		t.generate(out.data(), out.size());
+
+		if(n_threads == 1)
+			first = out;
+		else
+			check(out == first, "16-bit block partition with " + std::to_string(n_threads) + " threads");
+	}
+}
+
+// ======================================
+// 			  Bernoulli bits
+// ======================================
+
+// Put the low bits of src into the set bits of mask one at a time
+static std::uint64_t naive_deposit(std::uint64_t src, const std::uint64_t mask)
+{
+	std::uint64_t result = 0;
+	for(unsigned int i = 0; i < 64; i++)
+	{
+		if((mask >> i) & 1)
+		{
+			result |= (src & 1) << i;
+			src >>= 1;
+		}
+	}
+	return result;
+}
+
+// Words from a generator that has been asked for p, and whether the generator was
+// left where it was, for the values of p that need no random bits
+static std::vector<std::uint64_t> bernoulli_words(const double p, bool& untouched)
+{
+	Threaded_rands<std::uint64_t, std::uint64_t> t(1, generator_type::sfc, 3);
+	std::vector<std::uint64_t> words(1000);
+	t.generate_bernoulli(words, p);
+
+	Threaded_rands<std::uint64_t, std::uint64_t> fresh(1, generator_type::sfc, 3);
+	std::vector<std::uint64_t> after(4), expected(4);
+	t.generate(after);
+	fresh.generate(expected);
+	untouched = after == expected;
+
+	return words;
+}
+
+static void test_bernoulli()
+{
+	splitmix64<std::uint64_t> src_gen(17);
+	bool ok = true;
+	for(unsigned int i = 0; i < 10000; i++)
+	{
+		// Masks with few, many and about half their bits set
+		const std::uint64_t a = src_gen(), b = src_gen(), c = src_gen();
+		for(const std::uint64_t mask : {a, a & b, a & b & c, a | b, a | b | c, ~std::uint64_t(0), std::uint64_t(0)})
+			ok = ok && simd::deposit_bits(c, mask) == naive_deposit(c, mask);
+	}
+	check(ok, "deposit_bits");
+
+	// p at or outside the ends of [0:1] gives constant words without drawing
+	const double nan = std::numeric_limits<double>::quiet_NaN();
+	for(const double p : {0.0, -0.5, nan, 1.0, 1.5})
+	{
+		bool untouched = false;
+		const std::vector<std::uint64_t> words = bernoulli_words(p, untouched);
+		const std::uint64_t expected = (p >= 1) ? ~std::uint64_t(0) : 0;
+
+		ok = true;
+		for(const std::uint64_t w : words)
+			ok = ok && w == expected;
+		check(ok && untouched, "Bernoulli words with p = " + std::to_string(p));
+	}
+
+	// Tiny p rounds down to 0 in fixed point or has no set bits in 64000, and p a
+	// rounding error below 1 leaves no bits clear
+	const std::pair<double, std::string> near_ends[] = {{1e-300, "1e-300"}, {0x1p-60, "2^-60"}, {1 - 0x1p-53, "1 - 2^-53"}};
+	for(const auto& [p, p_name] : near_ends)
+	{
+		bool untouched = false;
+		const std::vector<std::uint64_t> words = bernoulli_words(p, untouched);
+		const std::uint64_t expected = (p > 0.5) ? ~std::uint64_t(0) : 0;
+
+		ok = true;
+		for(const std::uint64_t w : words)
+			ok = ok && w == expected;
+		check(ok, "Bernoulli words with p = " + p_name);
+	}
+
+	// The fraction of set bits is within 6 standard deviations of p
+	for(const double p : {0.1, 1.0 / 3, 0.5, 0.9})
+	{
+		Threaded_rands<std::uint64_t, std::uint64_t> t(1, generator_type::philox, 3);
+		std::vector<std::uint64_t> words(4096);
+		t.generate_bernoulli(words, p);
+
+		std::size_t n_set = 0;
+		for(const std::uint64_t w : words)
+			n_set += __builtin_popcountll(w);
+
+		const double n_bits = 64.0 * words.size();
+		check(std::abs(n_set - p * n_bits) <= 6 * std::sqrt(n_bits * p * (1 - p)),
+			  "Bernoulli fraction with p = " + std::to_string(p));
+	}
+
+	// Each random digit decides half the undecided bits, so a word takes two words of
+	// random bits on average. p = 1/2 decides every bit on its first digit
+	for(const double p : {0.1, 1.0 / 3, 0.5, 0.9})
+	{
+		splitmix64<std::uint64_t> gen(5);
+		std::size_t n_drawn = 0;
+		auto next = [&]{ n_drawn++; return gen(); };
+
+		std::vector<std::uint64_t> words(10000);
+		bernoulli_fill(next, words.data(), words.size(), static_cast<std::uint64_t>(p * 0x1p64));
+
+		const double per_word = double(n_drawn) / words.size();
+		check((p == 0.5) ? per_word <= 1.0 : (per_word > 1.8 && per_word < 2.2),
+			  "random words per Bernoulli word with p = " + std::to_string(p));
+	}
+}
+
+// ======================================
+// 			   Raw bytes
+// ======================================
+
+// The bytes of the first n_bytes / 8 rands of an identically seeded generator
+// and the start of one more
+static std::vector<unsigned char> expected_bytes(const generator_type sel, const std::size_t n_bytes)
+{
+	Threaded_rands<std::uint64_t, std::uint64_t> ref(1, sel, 8);
+	std::vector<std::uint64_t> whole(n_bytes / 8);
+	ref.generate(whole);
+	std::vector<std::uint64_t> tail(1);
+	ref.generate(tail);
+	whole.push_back(tail[0]);
+
+	std::vector<unsigned char> bytes(n_bytes);
+	std::memcpy(bytes.data(), whole.data(), n_bytes);
+	return bytes;
+}
+
+// The offset from p to the next 16-byte boundary
+static std::size_t to_aligned(const void* p)
+{
+	return (16 - reinterpret_cast<std::uintptr_t>(p) % 16) % 16;
+}
+
+static void test_fill_bytes()
+{
+	// Every short length at every offset from a 16-byte boundary, leaving the
+	// bytes either side alone
+	for(const generator_type sel : {generator_type::sfc, generator_type::philox})
+	{
+		bool ok = true;
+		for(std::size_t n = 0; n <= 17; n++)
+		{
+			const std::vector<unsigned char> expected = expected_bytes(sel, n);
+
+			for(std::size_t offset = 0; offset < 8; offset++)
+			{
+				Threaded_rands<std::uint64_t, std::uint64_t> t(1, sel, 8);
+
+				std::vector<unsigned char> buffer(64, 0xa5);
+				unsigned char* first = buffer.data() + to_aligned(buffer.data()) + 8 + offset;
+				t.fill_bytes(first, n);
+
+				ok = ok && std::memcmp(first, expected.data(), n) == 0;
+				for(const unsigned char* p = buffer.data(); p != buffer.data() + buffer.size(); ++p)
+					ok = ok && (*p == 0xa5 || (p >= first && p < first + n));
+			}
+		}
+		check(ok, "short byte fills with generator " + std::to_string(static_cast<int>(sel)));
+	}
+
+	// Fills long enough to be shared between the threads are the same for any number
+	// of threads with block partitioning, and stay inside the region
+	std::vector<unsigned char> first;
+	for(unsigned int n_threads = 1; n_threads <= 3; n_threads++)
+	{
+		Threaded_rands<std::uint64_t, std::uint64_t> t(n_threads, generator_type::xoshiro256pp, 8);
+		t.set_partition(partition_type::block, 4099);
+
+		const std::size_t n = 200003;
+		std::vector<unsigned char> buffer(n + 32, 0xa5);
+		unsigned char* data = buffer.data() + to_aligned(buffer.data()) + 3;
+		t.fill_bytes(data, n);
+
+		bool guards = true;
+		for(const unsigned char* p = buffer.data(); p != data; ++p)
+			guards = guards && *p == 0xa5;
+		for(const unsigned char* p = data + n; p != buffer.data() + buffer.size(); ++p)
+			guards = guards && *p == 0xa5;
+		check(guards, "parallel byte fill stays in its region with " + std::to_string(n_threads) + " threads");
+
+		std::vector<unsigned char> out(data, data + n);
+		if(n_threads == 1)
+			first = out;
+		else
+			check(out == first, "byte block partition with " + std::to_string(n_threads) + " threads");
+	}
+
+	// A fill long enough for streaming stores gives the same bytes at an aligned address,
+	// where it streams, as at an unaligned one, where it doesn't. One block covers the
+	// whole fill, which also makes xoro128 reproducible
+	for(const generator_type sel : {generator_type::xoro128, generator_type::philox})
+	{
+		const std::size_t n = (std::size_t(1) << 22) + 13;
+		std::vector<unsigned char> aligned_buffer(n + 16), unaligned_buffer(n + 16);
+
+		unsigned char* aligned = aligned_buffer.data() + to_aligned(aligned_buffer.data());
+		Threaded_rands<std::uint64_t, std::uint64_t> a(1, sel, 8);
+		a.set_partition(partition_type::block, n);
+		a.fill_bytes(aligned, n);
+
+		unsigned char* unaligned = unaligned_buffer.data() + to_aligned(unaligned_buffer.data()) + 1;
+		Threaded_rands<std::uint64_t, std::uint64_t> b(1, sel, 8);
+		b.set_partition(partition_type::block, n);
+		b.fill_bytes(unaligned, n);
+
+		check(std::memcmp(aligned, unaligned, n) == 0, "streamed byte fill with generator " + std::to_string(static_cast<int>(sel)));
+	}
+}
+
+// ======================================
+// 				Philox4x32-10
+// ======================================
+
+// The known answers from Random123's kat_vectors
+static void test_philox()
+{
+	struct kat { std::uint32_t ctr[4]; std::uint32_t key[2]; std::uint32_t expected[4]; };
+
+	const kat kats[] = {
+		{{0, 0, 0, 0}, {0, 0}, {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}},
+		{{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}, {0xffffffff, 0xffffffff}, {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}},
+		{{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, {0xa4093822, 0x299f31d0}, {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}}};
+
+	for(const kat& k : kats)
+	{
+		philox_counter counter{{k.key[0], k.key[1]}, std::uint64_t(k.ctr[1]) << 32 | k.ctr[0], std::uint64_t(k.ctr[3]) << 32 | k.ctr[2]};
+
+		std::uint32_t scalar[4];
+		philox4x32_10(counter, counter.block, scalar);
+		check(equal(scalar, k.expected, 4), "philox scalar known answer");
+
+		// The first block of a bulk fill, all 8 lanes worth and just the one block
+		std::uint32_t bulk[32];
+		philox_counter c = counter;
+		philox_fill<32>(c, simd::int_out<std::uint32_t>{bulk}, 32);
+		check(equal(bulk, k.expected, 4), "philox bulk known answer");
+
+		c = counter;
+		philox_fill<32>(c, simd::int_out<std::uint32_t>{bulk}, 3);
+		check(equal(bulk, k.expected, 3) && c.block == counter.block + 1, "philox partial block");
+	}
+}
+
+// ======================================
+// 				Threefry4x64
+// ======================================
+
+static void test_threefry()
+{
+	const std::uint64_t zero_20[4] = {0x09218ebde6c85537, 0x55941f5266d86105, 0x4bd25e16282434dc, 0xee29ec846bd2e40b};
+	const std::uint64_t ones_20[4] = {0x29c24097942bba1b, 0x0371bbfb0f6f4e11, 0x3c231ffa33f83a1c, 0xcd29113fde32d168};
+	const std::uint64_t zero_13[4] = {0x4071fabee1dc8e05, 0x02ed3113695c9c62, 0x397311b5b89f9d49, 0xe21292c3258024bc};
+
+	const std::uint64_t zero_key[4] = {0, 0, 0, 0};
+	const std::uint64_t ones_key[4] = {~0ull, ~0ull, ~0ull, ~0ull};
+
+	threefry_counter counter;
+	threefry_key(counter, zero_key);
+	counter.block = 0;
+	counter.stream = 0;
+
+	std::uint64_t out[32];
+	threefry_counter c = counter;
+	threefry_fill<64, 20>(c, simd::int_out<std::uint64_t>{out}, 32);
+	check(equal(out, zero_20, 4), "threefry20 bulk known answer");
+
+	c = counter;
+	threefry_fill<64, 13>(c, simd::int_out<std::uint64_t>{out}, 4);
+	check(equal(out, zero_13, 4), "threefry13 bulk known answer");
+
+	// The all ones counter has words 2 and 3 set, which the generator never uses
+	threefry_counter ones;
+	threefry_key(ones, ones_key);
+	std::uint64_t x[4] = {~0ull, ~0ull, ~0ull, ~0ull};
+	simd::threefry_rounds<20>(ones.key, x[0], x[1], x[2], x[3]);
+	check(equal(x, ones_20, 4), "threefry20 scalar known answer");
+
+	const std::uint64_t ones_13[4] = {0x7eaed935479722b5, 0x90994358c429f31c, 0x496381083e07a75b, 0x627ed0d746821121};
+	std::uint64_t y[4] = {~0ull, ~0ull, ~0ull, ~0ull};
+	simd::threefry_rounds<13>(ones.key, y[0], y[1], y[2], y[3]);
+	check(equal(y, ones_13, 4), "threefry13 scalar known answer");
+
+	// The digits of pi as the counter and key
+	const std::uint64_t pi_ctr[4] = {0x243f6a8885a308d3, 0x13198a2e03707344, 0xa4093822299f31d0, 0x082efa98ec4e6c89};
+	const std::uint64_t pi_key[4] = {0x452821e638d01377, 0xbe5466cf34e90c6c, 0xc0ac29b7c97c50dd, 0x3f84d5b5b5470917};
+	const std::uint64_t pi_13[4] = {0x4361288ef9c1900c, 0x8717291521782833, 0x0d19db18c20cf47e, 0xa0b41d63ac8581e5};
+
+	threefry_counter pi;
+	threefry_key(pi, pi_key);
+	std::uint64_t z[4];
+	std::memcpy(z, pi_ctr, sizeof(z));
+	simd::threefry_rounds<13>(pi.key, z[0], z[1], z[2], z[3]);
+	check(equal(z, pi_13, 4), "threefry13 pi known answer");
+
+	// The bulk fill is the same function of the counter as the scalar rounds, for a
+	// block well into a stream
+	threefry_counter far = pi;
+	far.block = 0x0123456789abcdef;
+	far.stream = 0xfedcba9876543210;
+
+	std::uint64_t scalar[4];
+	threefry4x64<20>(far, far.block, scalar);
+	c = far;
+	threefry_fill<64, 20>(c, simd::int_out<std::uint64_t>{out}, 9);
+	check(equal(out, scalar, 4) && c.block == far.block + 3, "threefry bulk fill far into a stream");
+}
+
+// ======================================
+// 		 xoshiro256++ / xoshiro256**
+// ======================================
+
+// The first outputs of the reference code from a state of {1, 2, 3, 4}
+static const std::uint64_t xoshiro_pp_1234[6] = {0x0000000002800001, 0x0000000003800067, 0x000cc00003800067,
+												 0x000cc201994400b2, 0x8012a2019ac433cd, 0x8a69978acdee33ba};
+static const std::uint64_t xoshiro_ss_1234[6] = {0x0000000000002d00, 0x0000000000000000, 0x000000005a007080,
+												 0x10e0000000009d80, 0x10e0b61ce1009d80, 0x0870021ce143ad00};
+
+template<bool StarStar, typename state_type = std::uint64_t>
+struct xoshiro_test : xoshiro256<state_type, StarStar>
+{
+	using xoshiro256<state_type, StarStar>::xoshiro256;
+
+	void set_state(const std::uint64_t (&s)[4]) { std::memcpy(this->seed_array, s, sizeof(s)); }
+};
+
+template<bool StarStar>
+static void test_xoshiro()
+{
+	const std::uint64_t* expected = StarStar ? xoshiro_ss_1234 : xoshiro_pp_1234;
+	const std::string name = StarStar ? "xoshiro256**" : "xoshiro256++";
+
+	xoshiro_test<StarStar> g(0, 1);
+	g.set_state({1, 2, 3, 4});
+
+	std::uint64_t scalar[6];
+	for(auto& r : scalar)
+		r = g.get_rand();
+	check(equal(scalar, expected, 6), name + " scalar known answer");
+
+	// Every lane from the same state, lane l gives element l of each group of 8
+	xoshiro256_lanes lanes;
+	for(std::size_t l = 0; l < simd::n_lanes; l++)
+	{
+		lanes.s0[l] = 1;
+		lanes.s1[l] = 2;
+		lanes.s2[l] = 3;
+		lanes.s3[l] = 4;
+	}
+
+	std::uint64_t bulk[6 * simd::n_lanes];
+	xoshiro256_fill<StarStar>(lanes, simd::int_out<std::uint64_t>{bulk}, 6 * simd::n_lanes);
+
+	bool ok = true;
+	for(std::size_t i = 0; i < 6 * simd::n_lanes; i++)
+		ok = ok && bulk[i] == expected[i / simd::n_lanes];
+	check(ok, name + " bulk known answer");
+
+	// The next thread's stream and lanes mustn't land on anything drawn by the one before
+	std::set<std::uint64_t> drawn;
+
+	for(unsigned int round = 0; round < 2; round++)
+	{
+		std::uint64_t rands[64 + 8];
+		xoshiro_test<StarStar> copy(3 + round, 12345);
+		copy.fill(simd::int_out<std::uint64_t>{rands}, 64);
+		for(unsigned int i = 64; i < 72; i++)
+			rands[i] = copy.get_rand();
+
+		unsigned int repeats = 0;
+		for(const std::uint64_t r : rands)
+			repeats += drawn.count(r);
+		check(repeats == 0, name + " thread stream overlap");
+
+		drawn.insert(rands, rands + 72);
+	}
+
+	// The same for long jumps, which also land somewhere other than a jump
+	xoshiro_test<StarStar> lj(3, 12345);
+	drawn.clear();
+	for(unsigned int round = 0; round < 3; round++)
+	{
+		std::uint64_t rands[64 + 8];
+		xoshiro_test<StarStar> copy = (round == 2) ? xoshiro_test<StarStar>(4, 12345) : lj;
+		copy.fill(simd::int_out<std::uint64_t>{rands}, 64);
+		for(unsigned int i = 64; i < 72; i++)
+			rands[i] = copy.get_rand();
+
+		unsigned int repeats = 0;
+		for(const std::uint64_t r : rands)
+			repeats += drawn.count(r);
+		check(repeats == 0, name + " long jump overlap");
+
+		drawn.insert(rands, rands + 72);
+		lj.long_jump();
+	}
+
+	// The 32-bit generator gives the top half of each output
+	xoshiro_test<StarStar, std::uint32_t> g32(0, 1);
+	g32.set_state({1, 2, 3, 4});
+
+	ok = true;
+	for(unsigned int i = 0; i < 6; i++)
+		ok = ok && g32.get_rand() == static_cast<std::uint32_t>(expected[i] >> 32);
+	check(ok, name + " 32-bit known answer");
+
+	// A single jump moves the stream to where lane 0 started, 2^128 draws on
+	xoshiro256<std::uint64_t, StarStar> once(1, 99), lanes_of(1, 99);
+	once.jump();
+
+	std::uint64_t lane_rands[4 * simd::n_lanes];
+	lanes_of.fill(simd::int_out<std::uint64_t>{lane_rands}, 4 * simd::n_lanes);
+	ok = true;
+	for(unsigned int i = 0; i < 4; i++)
+		ok = ok && once.get_rand() == lane_rands[i * simd::n_lanes];
+	check(ok, name + " jump() is a single jump");
+
+	// Thread t's stream and lanes are where thread 0's are after 9t jumps
+	xoshiro256<std::uint64_t, StarStar> thread0(0, 99), thread2(2, 99);
+	for(unsigned int j = 0; j < 2 * (simd::n_lanes + 1); j++)
+		thread0.jump();
+
+	std::uint64_t a[40], b[40];
+	thread0.fill(simd::int_out<std::uint64_t>{a}, 32);
+	thread2.fill(simd::int_out<std::uint64_t>{b}, 32);
+	for(unsigned int i = 32; i < 40; i++)
+	{
+		a[i] = thread0.get_rand();
+		b[i] = thread2.get_rand();
+	}
+	check(equal(a, b, 40), name + " thread streams are jumps apart");
+
+	// Threaded_rands::long_jump moves every thread's generator on by the same number of long jumps
+	const generator_type sel = StarStar ? generator_type::xoshiro256ss : generator_type::xoshiro256pp;
+	Threaded_rands<std::uint64_t, std::uint64_t> t(2, sel, 99);
+	t.long_jump(2);
+
+	ok = true;
+	for(unsigned int thread_id = 0; thread_id < 2; thread_id++)
+	{
+		xoshiro256<std::uint64_t, StarStar> ref(thread_id, 99);
+		ref.long_jump();
+		ref.long_jump();
+		for(unsigned int i = 0; i < 8; i++)
+			ok = ok && t.get_rand(thread_id) == ref.get_rand();
+	}
+	check(ok, name + " Threaded_rands long_jump");
+
+	// and leaves the other generators where they were
+	if constexpr(!StarStar)
+	{
+		Threaded_rands<std::uint64_t, std::uint64_t> jumped(1, generator_type::sfc, 99), fresh(1, generator_type::sfc, 99);
+		jumped.long_jump();
+		ok = true;
+		for(unsigned int i = 0; i < 8; i++)
+			ok = ok && jumped.get_rand() == fresh.get_rand();
+		check(ok, "Threaded_rands long_jump leaves sfc alone");
+	}
+}
+
+// ======================================
+// 				 SFC64
+// ======================================
+
+// The first outputs of PractRand's sfc64 from a = 1, b = 2, c = 3 and a counter of 1
+static const std::uint64_t sfc64_123[6] = {0x0000000000000004, 0x000000000000001f, 0x000000001b000042,
+										   0x001b00003f03613f, 0x003f03622e049e6e, 0x032104a1935fec8e};
+
+struct sfc_test : sfc<std::uint64_t>
+{
+	using sfc::sfc;
+
+	void set_state(const std::uint64_t a, const std::uint64_t b, const std::uint64_t c)
+	{
+		a_ = a;
+		b_ = b;
+		c_ = c;
+		counter_ = 1;
+	}
+};
+
+static void test_sfc()
+{
+	sfc_test g(0, 1);
+	g.set_state(1, 2, 3);
+
+	std::uint64_t scalar[6];
+	for(auto& r : scalar)
+		r = g.get_rand();
+	check(equal(scalar, sfc64_123, 6), "sfc64 scalar known answer");
+
+	sfc64_lanes lanes;
+	for(std::size_t l = 0; l < simd::n_lanes; l++)
+	{
+		lanes.a[l] = 1;
+		lanes.b[l] = 2;
+		lanes.c[l] = 3;
+		lanes.counter[l] = 1;
+	}
+
+	std::uint64_t bulk[6 * simd::n_lanes];
+	sfc64_fill(lanes, simd::int_out<std::uint64_t>{bulk}, 6 * simd::n_lanes);
+
+	bool ok = true;
+	for(std::size_t i = 0; i < 6 * simd::n_lanes; i++)
+		ok = ok && bulk[i] == sfc64_123[i / simd::n_lanes];
+	check(ok, "sfc64 bulk known answer");
+
+	// seed() starts the counter at 1 and throws away the first 12 outputs
+	sfc_test seeded(0, 1), by_hand(0, 1);
+	seeded.seed(1, 2, 3);
+	by_hand.set_state(1, 2, 3);
+	for(unsigned int i = 0; i < 12; i++)
+		by_hand.get_rand();
+
+	ok = true;
+	for(unsigned int i = 0; i < 8; i++)
+		ok = ok && seeded.get_rand() == by_hand.get_rand();
+	check(ok, "sfc64 seed()");
+
+	// A thread's generator and then each of its lanes are seeded from the next three
+	// values of a SplitMix64 seeded with the master seed and the hashed thread id
+	const std::uint64_t master_seed = 42;
+	const unsigned int thread_id = 3;
+	splitmix64<std::uint64_t> stream_hash(thread_id);
+	splitmix64<std::uint64_t> seed_gen(master_seed ^ stream_hash());
+
+	sfc<std::uint64_t> g3(thread_id, master_seed);
+	std::vector<sfc_test> refs(simd::n_lanes + 1, sfc_test(0, 1));
+	for(sfc_test& r : refs)
+	{
+		const std::uint64_t a = seed_gen(), b = seed_gen(), c = seed_gen();
+		r.seed(a, b, c);
+	}
+
+	ok = true;
+	for(unsigned int i = 0; i < 8; i++)
+		ok = ok && g3.get_rand() == refs[0].get_rand();
+	check(ok, "sfc64 thread seeding");
+
+	std::vector<std::uint64_t> lane_rands(5 * simd::n_lanes);
+	g3.fill(simd::int_out<std::uint64_t>{lane_rands.data()}, lane_rands.size());
+	ok = true;
+	for(std::size_t i = 0; i < lane_rands.size(); i++)
+		ok = ok && lane_rands[i] == refs[1 + i % simd::n_lanes].get_rand();
+	check(ok, "sfc64 lane seeding");
+
+	// So a thread's stream doesn't depend on how many threads there are
+	Threaded_rands<std::uint64_t, std::uint64_t> one(1, generator_type::sfc, master_seed), four(4, generator_type::sfc, master_seed);
+	sfc<std::uint64_t> g3_again(thread_id, master_seed);
+	ok = true;
+	for(unsigned int i = 0; i < 8; i++)
+		ok = ok && one.get_rand(0) == four.get_rand(0) && four.get_rand(thread_id) == g3_again.get_rand();
+	check(ok, "sfc64 thread streams don't depend on the thread count");
+}
+
+// ======================================
+// 				ChaCha
+// ======================================
+
+template<typename state_type, unsigned int Rounds>
+struct chacha_test : chacha<state_type, Rounds>
+{
+	chacha_test(const std::uint32_t (&key)[8], const std::uint64_t block, const std::uint64_t stream)
+	{
+		std::memcpy(this->counter.key, key, sizeof(key));
+		this->counter.block = block;
+		this->counter.stream = stream;
+	}
+};
+
+// The first block of keystream for an all zero key, counter and nonce
+template<unsigned int Rounds>
+static void test_chacha_known_answer(const std::uint8_t (&expected)[64])
+{
+	const std::uint32_t key[8] = {};
+	chacha_test<std::uint32_t, Rounds> g(key, 0, 0);
+
+	std::uint8_t keystream[64];
+	for(unsigned int i = 0; i < 16; i++)
+	{
+		const std::uint32_t w = g.get_rand();
+		for(unsigned int b = 0; b < 4; b++)
+			keystream[4 * i + b] = static_cast<std::uint8_t>(w >> (8 * b));
+	}
+
+	check(equal(keystream, expected, 64), "chacha" + std::to_string(Rounds) + " known answer");
+}
+
+// Bulk fills of any length match get_rand() and leave the stream at the next whole
+// block, across the carry from the low to the high word of the block counter
+template<typename state_type, unsigned int Rounds>
+static void test_chacha_fills(const std::uint64_t first_block)
+{
+	const std::uint32_t key[8] = {0x03020100, 0x07060504, 0x0b0a0908, 0x0f0e0d0c, 0x13121110, 0x17161514, 0x1b1a1918, 0x1f1e1d1c};
+	const std::size_t per_block = 64 / sizeof(state_type);
+
+	std::vector<state_type> expected(2000);
+	chacha_test<state_type, Rounds> g(key, first_block, 0x4a00000009000000);
+	for(auto& r : expected)
+		r = g.get_rand();
+
+	for(const std::size_t n : {1, 7, 8, 15, 16, 17, 129, 256, 1000})
+	{
+		chacha_test<state_type, Rounds> h(key, first_block, 0x4a00000009000000);
+		std::vector<state_type> out(n + 1, 0);
+		h.fill(simd::int_out<state_type>{out.data()}, n);
+
+		check(equal(out.data(), expected.data(), n) && out[n] == 0, "chacha fill of " + std::to_string(n));
+		check(h.get_rand() == expected[(n + per_block - 1) / per_block * per_block], "chacha fill leaves the next block");
+	}
+}
+
+static void test_chacha()
+{
+	const std::uint8_t chacha20[64] = {
+		0x76, 0xb8, 0xe0, 0xad, 0xa0, 0xf1, 0x3d, 0x90, 0x40, 0x5d, 0x6a, 0xe5, 0x53, 0x86, 0xbd, 0x28,
+		0xbd, 0xd2, 0x19, 0xb8, 0xa0, 0x8d, 0xed, 0x1a, 0xa8, 0x36, 0xef, 0xcc, 0x8b, 0x77, 0x0d, 0xc7,
+		0xda, 0x41, 0x59, 0x7c, 0x51, 0x57, 0x48, 0x8d, 0x77, 0x24, 0xe0, 0x3f, 0xb8, 0xd8, 0x4a, 0x37,
+		0x6a, 0x43, 0xb8, 0xf4, 0x15, 0x18, 0xa1, 0x1c, 0xc3, 0x87, 0xb6, 0x69, 0xb2, 0xee, 0x65, 0x86};
+	const std::uint8_t chacha12[64] = {
+		0x9b, 0xf4, 0x9a, 0x6a, 0x07, 0x55, 0xf9, 0x53, 0x81, 0x1f, 0xce, 0x12, 0x5f, 0x26, 0x83, 0xd5,
+		0x04, 0x29, 0xc3, 0xbb, 0x49, 0xe0, 0x74, 0x14, 0x7e, 0x00, 0x89, 0xa5, 0x2e, 0xae, 0x15, 0x5f,
+		0x05, 0x64, 0xf8, 0x79, 0xd2, 0x7a, 0xe3, 0xc0, 0x2c, 0xe8, 0x28, 0x34, 0xac, 0xfa, 0x8c, 0x79,
+		0x3a, 0x62, 0x9f, 0x2c, 0xa0, 0xde, 0x69, 0x19, 0x61, 0x0b, 0xe8, 0x2f, 0x41, 0x13, 0x26, 0xbe};
+	const std::uint8_t chacha8[64] = {
+		0x3e, 0x00, 0xef, 0x2f, 0x89, 0x5f, 0x40, 0xd6, 0x7f, 0x5b, 0xb8, 0xe8, 0x1f, 0x09, 0xa5, 0xa1,
+		0x2c, 0x84, 0x0e, 0xc3, 0xce, 0x9a, 0x7f, 0x3b, 0x18, 0x1b, 0xe1, 0x88, 0xef, 0x71, 0x1a, 0x1e,
+		0x98, 0x4c, 0xe1, 0x72, 0xb9, 0x21, 0x6f, 0x41, 0x9f, 0x44, 0x53, 0x67, 0x45, 0x6d, 0x56, 0x19,
+		0x31, 0x4a, 0x42, 0xa3, 0xda, 0x86, 0xb0, 0x01, 0x38, 0x7b, 0xfd, 0xb8, 0x0e, 0x0c, 0xfe, 0x42};
+
+	test_chacha_known_answer<20>(chacha20);
+	test_chacha_known_answer<12>(chacha12);
+	test_chacha_known_answer<8>(chacha8);
+
+	// The block function test vector of RFC 8439 section 2.3.2, where the first word of
+	// the nonce is the high word of the block counter and the other two are the stream
+	const std::uint32_t rfc_key[8] = {0x03020100, 0x07060504, 0x0b0a0908, 0x0f0e0d0c, 0x13121110, 0x17161514, 0x1b1a1918, 0x1f1e1d1c};
+	const std::uint8_t rfc_block[64] = {
+		0x10, 0xf1, 0xe7, 0xe4, 0xd1, 0x3b, 0x59, 0x15, 0x50, 0x0f, 0xdd, 0x1f, 0xa3, 0x20, 0x71, 0xc4,
+		0xc7, 0xd1, 0xf4, 0xc7, 0x33, 0xc0, 0x68, 0x03, 0x04, 0x22, 0xaa, 0x9a, 0xc3, 0xd4, 0x6c, 0x4e,
+		0xd2, 0x82, 0x64, 0x46, 0x07, 0x9f, 0xaa, 0x09, 0x14, 0xc2, 0xd7, 0x05, 0xd9, 0x8b, 0x02, 0xa2,
+		0xb5, 0x12, 0x9c, 0xd1, 0xde, 0x16, 0x4e, 0xb9, 0xcb, 0xd0, 0x83, 0xe8, 0xa2, 0x50, 0x3c, 0x4e};
+
+	chacha_test<std::uint32_t, 20> rfc(rfc_key, std::uint64_t(0x09000000) << 32 | 1, 0x4a000000);
+	std::uint8_t keystream[64];
+	for(unsigned int i = 0; i < 16; i++)
+	{
+		const std::uint32_t w = rfc.get_rand();
+		for(unsigned int b = 0; b < 4; b++)
+			keystream[4 * i + b] = static_cast<std::uint8_t>(w >> (8 * b));
+	}
+	check(equal(keystream, rfc_block, 64), "chacha20 RFC 8439 block");
+
+	// A 64-bit rand is two words of keystream with the first in the low half
+	chacha_test<std::uint32_t, 20> words(rfc_key, 5, 7);
+	chacha_test<std::uint64_t, 20> pairs(rfc_key, 5, 7);
+	bool ok = true;
+	for(unsigned int i = 0; i < 100; i++)
+	{
+		const std::uint64_t w0 = words.get_rand();
+		const std::uint64_t w1 = words.get_rand();
+		ok = ok && pairs.get_rand() == (w0 | w1 << 32);
+	}
+	check(ok, "chacha 64-bit rands from pairs of words");
+
+	for(const std::uint64_t block : {0ull, 0xfffffff8ull})
+	{
+		test_chacha_fills<std::uint64_t, 20>(block);
+		test_chacha_fills<std::uint32_t, 20>(block);
+		test_chacha_fills<std::uint64_t, 8>(block);
+	}
+
+	// Setting the partition again mustn't give out the same keystream blocks again
+	Threaded_rands<std::uint64_t, std::uint64_t> t(2, generator_type::chacha);
+	std::vector<std::uint64_t> a(4096), b(4096);
+	t.set_partition(partition_type::block, 1024);
+	t.generate(a.data(), a.size());
+	t.set_partition(partition_type::block, 1024);
+	t.generate(b.data(), b.size());
+	check(a != b, "chacha keystream repeated after set_partition");
+
+	// The key is never taken from the master seed, so the same seed gives different keystreams
+	Threaded_rands<std::uint64_t, std::uint64_t> c1(1, generator_type::chacha, 5), c2(1, generator_type::chacha, 5);
+	std::vector<std::uint64_t> k1(64), k2(64);
+	c1.generate(k1);
+	c2.generate(k2);
+	check(k1 != k2, "chacha keyed from the master seed");
+}
+
+// ======================================
+// 		 Counter-based random access
+// ======================================
+
+// per_block is the number of rands in each block of the generator
+template<typename G>
+static void test_random_access(const std::string& name, const std::size_t per_block)
+{
+	using S = decltype(std::declval<G&>().get_rand());
+
+	G g(2, 12345);
+	G h = g;
+
+	std::vector<S> drawn(50);
+	for(auto& r : drawn)
+		r = g.get_rand();
+
+	bool ok = true;
+	for(std::size_t i = 0; i < drawn.size(); i++)
+		ok = ok && h.at(i) == drawn[i] && G::stream_at(12345, 2, i) == drawn[i];
+	check(ok, name + " at() matches get_rand()");
+
+	h.seek(13);
+	check(h.position() == 13 && h.get_rand() == drawn[13] && h.position() == 14, name + " seek()");
+
+	std::vector<S> bulk(37);
+	G f = G(2, 12345);
+	f.fill(simd::int_out<S>{bulk.data()}, bulk.size());
+	check(equal(bulk.data(), drawn.data(), bulk.size()), name + " fill() matches get_rand()");
+
+	// A fill skips what is left of get_rand()'s block and get_rand() carries on after it
+	G e = G(2, 12345);
+	e.get_rand();
+	e.fill(simd::int_out<S>{bulk.data()}, 5);
+	check(equal(bulk.data(), drawn.data() + per_block, 5) && e.get_rand() == drawn[(per_block + 5 + per_block - 1) / per_block * per_block],
+		  name + " fill() after get_rand()");
+}
+
+// Threaded_rands::get_rand_at gives each thread's get_rand() sequence, shifted the same way
+template<typename result_type, typename state_type>
+static void test_threaded_rand_at(const generator_type sel, const std::string& name)
+{
+	Threaded_rands<result_type, state_type> t(2, sel, 77);
+
+	bool ok = true;
+	for(unsigned int thread_id = 0; thread_id < 2; thread_id++)
+		for(std::uint64_t i = 0; i < 40; i++)
+			ok = ok && t.get_rand_at(i, thread_id) == t.get_rand(thread_id);
+	check(ok, name + " get_rand_at matches get_rand");
+}
+
+static void test_get_rand_at()
+{
+	test_random_access<philox<std::uint64_t>>("philox", 2);
+	test_random_access<philox<std::uint32_t>>("32-bit philox", 4);
+	test_random_access<threefry<std::uint64_t>>("threefry", 4);
+	test_random_access<threefry<std::uint64_t, 13>>("threefry13", 4);
+	test_random_access<threefry<std::uint32_t>>("32-bit threefry", 8);
+
+	test_threaded_rand_at<std::uint64_t, std::uint64_t>(generator_type::philox, "philox");
+	test_threaded_rand_at<std::uint32_t, std::uint32_t>(generator_type::philox, "32-bit philox");
+	test_threaded_rand_at<std::uint32_t, std::uint64_t>(generator_type::philox, "philox shifted to 32 bits");
+	test_threaded_rand_at<std::uint64_t, std::uint64_t>(generator_type::threefry, "threefry");
+	test_threaded_rand_at<std::uint32_t, std::uint32_t>(generator_type::threefry13, "32-bit threefry13");
+
+	Threaded_rands<std::uint64_t, std::uint64_t> sfc_rands(1, generator_type::sfc, 1);
+	bool threw = false;
+	try
+	{
+		sfc_rands.get_rand_at(10);
+	}
+	catch(const std::logic_error&)
+	{
+		threw = true;
+	}
+	check(threw, "get_rand_at throws without random access");
+}
+
+// ======================================
+// 		 Thread count invariance
+// ======================================
+
+// With block partitioning a seeded fill is the same for any number of threads
+static void test_block_partition()
+{
+	const generator_type seeded[] = {generator_type::pcg, generator_type::pcg_setseq, generator_type::xoro128, generator_type::jsf,
+									 generator_type::philox, generator_type::threefry, generator_type::threefry13,
+									 generator_type::xoshiro256pp, generator_type::xoshiro256ss, generator_type::sfc};
+
+	for(const generator_type sel : seeded)
+	{
+		std::vector<std::uint64_t> first;
+
+		for(unsigned int n_threads = 1; n_threads <= 4; n_threads++)
+		{
+			Threaded_rands<std::uint64_t, std::uint64_t> t(n_threads, sel, 2024);
+			t.set_partition(partition_type::block, 1000);
+
+			std::vector<std::uint64_t> out(10007);
+			t.generate(out.data(), out.size());
+
+			if(n_threads == 1)
+				first = out;
+			else
+				check(out == first, "block partition with " + std::to_string(n_threads) + " threads, generator " +
+									std::to_string(static_cast<int>(sel)));
+		}
+	}
+}
+
+// Each block is filled by the selected generator from its own stream 2^63 + b,
+// rather than by some other generator standing in for it
+template<typename G>
+static void test_block_stream(const generator_type sel, const std::string& name)
+{
+	const std::size_t block_size = 1000;
+
+	Threaded_rands<std::uint64_t, std::uint64_t> t(2, sel, 2024);
+	t.set_partition(partition_type::block, block_size);
+
+	std::vector<std::uint64_t> out(2500);
+	t.generate(out.data(), out.size());
+
+	bool ok = true;
+	for(std::size_t first = 0; first < out.size(); first += block_size)
+	{
+		G g = G::substream(2024, std::uint64_t(1) << 63 | (first / block_size));
+
+		std::vector<std::uint64_t> expected(std::min(block_size, out.size() - first));
+		g.fill(simd::int_out<std::uint64_t>{expected.data()}, expected.size());
+
+		ok = ok && equal(out.data() + first, expected.data(), expected.size());
+	}
+	check(ok, name + " blocks come from its own streams");
+}
+
+static void test_block_streams()
+{
+	test_block_stream<xoroshiro128<std::uint64_t>>(generator_type::xoro128, "xoro128");
+	test_block_stream<jsf<std::uint64_t>>(generator_type::jsf, "jsf");
+	test_block_stream<philox<std::uint64_t>>(generator_type::philox, "philox");
+	test_block_stream<threefry<std::uint64_t>>(generator_type::threefry, "threefry");
+	test_block_stream<xoshiro256<std::uint64_t>>(generator_type::xoshiro256pp, "xoshiro256++");
+	test_block_stream<xoshiro256<std::uint64_t, true>>(generator_type::xoshiro256ss, "xoshiro256**");
+	test_block_stream<sfc<std::uint64_t>>(generator_type::sfc, "sfc");
+
+	// The 32-bit generators have block streams of their own as well
+	for(const generator_type sel : {generator_type::xoro128, generator_type::jsf, generator_type::xoshiro256pp, generator_type::sfc})
+	{
+		std::vector<std::uint32_t> first;
+
+		for(unsigned int n_threads = 1; n_threads <= 3; n_threads++)
+		{
+			Threaded_rands<std::uint32_t, std::uint32_t> t(n_threads, sel, 2024);
+			t.set_partition(partition_type::block, 1000);
+
+			std::vector<std::uint32_t> out(5003);
+			t.generate(out.data(), out.size());
+
+			if(n_threads == 1)
+				first = out;
+			else
+				check(out == first, "32-bit block partition with " + std::to_string(n_threads) + " threads, generator " +
+									std::to_string(static_cast<int>(sel)));
+		}
+	}
+}
+
+// ======================================
+// 			   Thread counts
+// ======================================
+
+static void test_thread_counts()
+{
+	Threaded_rands<std::uint64_t, std::uint64_t> counted({3}, generator_type::sfc, 1);
+	check(counted.get_n_threads() == 3, "{3} is a number of threads");
+
+	Threaded_rands<std::uint64_t, std::uint64_t> one_core(pinned_cores{0}, generator_type::sfc, 1);
+	check(one_core.get_n_threads() == 1, "pinned_cores{0} is one thread");
+
+	Threaded_rands<std::uint64_t, std::uint64_t> listed(pinned_cores(std::vector<unsigned int>{0, 0}), generator_type::sfc, 1);
+	check(listed.get_n_threads() == 2, "one thread for each core listed");
+
+	Threaded_rands<std::uint64_t, std::uint64_t> available(0, generator_type::sfc, 1);
+	check(available.get_n_threads() == std::max(1u, available_cpus()), "0 threads is one for each CPU available");
+}
+
+// ======================================
+// 				Worker pool
+// ======================================
+
+// Every job runs once on each worker, and an exception thrown by a job comes out of run()
+static void test_pool_run()
+{
+	worker_pool pool(3);
+
+	std::atomic<unsigned int> runs[3] = {};
+	for(unsigned int job = 0; job < 100; job++)
+		pool.run([&](const unsigned int worker_id){ runs[worker_id]++; });
+
+	check(runs[0] == 100 && runs[1] == 100 && runs[2] == 100, "pool runs each job once on every worker");
+
+	bool threw = false;
+	try
+	{
+		pool.run([](const unsigned int worker_id)
+		{
+			if(worker_id == 1)
+				throw std::runtime_error("job failed");
+		});
+	}
+	catch(const std::runtime_error&)
+	{
+		threw = true;
+	}
+	check(threw, "pool passes on an exception from a job");
+
+	std::atomic<unsigned int> after{0};
+	pool.run([&](const unsigned int){ after++; });
+	check(after == 3, "pool runs jobs after an exception");
+
+	// A single worker runs its jobs on the caller
+	worker_pool single(1);
+	std::thread::id ran_on;
+	single.run([&](const unsigned int){ ran_on = std::this_thread::get_id(); });
+	check(ran_on == std::this_thread::get_id(), "single worker pool runs on the caller");
+}
+
+// Every task index runs exactly once, including when most of them are stolen
+static void test_pool_tasks()
+{
+	worker_pool pool(4);
+
+	for(const std::size_t n_tasks : {0, 1, 3, 4, 1000, 100003})
+	{
+		std::unique_ptr<std::atomic<unsigned int>[]> runs(new std::atomic<unsigned int>[n_tasks]());
+
+		pool.run_tasks(n_tasks, [&](const unsigned int, const std::size_t task){ runs[task]++; });
+
+		bool ok = true;
+		for(std::size_t t = 0; t < n_tasks; t++)
+			ok = ok && runs[t] == 1;
+		check(ok, "run_tasks runs each of " + std::to_string(n_tasks) + " tasks once");
+	}
+
+	// Worker 0 starts with tasks [0:250) and holds on to task 0 until another worker
+	// has stolen one of the others, or gives up after a few seconds
+	const std::size_t n_tasks = 1000;
+	std::unique_ptr<std::atomic<unsigned int>[]> runs(new std::atomic<unsigned int>[n_tasks]());
+	std::atomic<bool> stolen{false};
+
+	pool.run_tasks(n_tasks, [&](const unsigned int worker_id, const std::size_t task)
+	{
+		runs[task]++;
+
+		if(task < n_tasks / 4 && worker_id != 0)
+			stolen = true;
+
+		if(task == 0)
+		{
+			const auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+			while(!stolen && std::chrono::steady_clock::now() < give_up)
+				std::this_thread::yield();
+		}
+	});
+
+	bool ok = true;
+	for(std::size_t t = 0; t < n_tasks; t++)
+		ok = ok && runs[t] == 1;
+	check(ok, "run_tasks runs each task once with stealing");
+	check(stolen, "run_tasks steals from a busy worker");
+}
+
+// ======================================
+// 				 Topology
+// ======================================
+
+static void test_cpu_list()
+{
+	check(parse_cpu_list("0-3,8,10-11") == std::vector<unsigned int>{0, 1, 2, 3, 8, 10, 11}, "cpu list with ranges");
+	check(parse_cpu_list("5") == std::vector<unsigned int>{5}, "cpu list of one CPU");
+	check(parse_cpu_list("").empty(), "empty cpu list");
+	check(parse_cpu_list("\n").empty(), "cpu list of a blank line");
+	check(parse_cpu_list("0-1,x,4") == std::vector<unsigned int>{0, 1, 4}, "cpu list with an entry that can't be read");
+}
+
+// A topology with the given CPUs on each node
+struct topology_test : numa_topology
+{
+	explicit topology_test(const std::vector<std::vector<unsigned int>>& nodes) { node_cpus = nodes; }
+};
+
+static void test_spread()
+{
+	const topology_test two_nodes({{0, 1}, {2, 3}});
+	check(two_nodes.spread(4) == std::vector<unsigned int>{0, 2, 1, 3}, "spread takes a CPU from each node in turn");
+	check(two_nodes.spread(6) == std::vector<unsigned int>{0, 2, 1, 3, 0, 2}, "spread wraps around with more workers than CPUs");
+	check(two_nodes.spread(0).empty(), "spread of no workers");
+
+	// A node that runs out of CPUs is skipped until every CPU is in use
+	const topology_test uneven({{0}, {1, 2, 3}});
+	check(uneven.spread(4) == std::vector<unsigned int>{0, 1, 2, 3}, "spread over uneven nodes");
+
+	const numa_topology restricted = two_nodes.restrict_to({1, 3});
+	check(restricted.n_nodes() == 2 && restricted.spread(2) == std::vector<unsigned int>{1, 3}, "spread over the allowed CPUs");
+	check(two_nodes.restrict_to({2, 3}).n_nodes() == 1, "nodes without allowed CPUs are dropped");
+	check(two_nodes.restrict_to({7}).n_nodes() == 2, "no allowed CPUs keeps the whole topology");
+}
+
+#if defined(__linux__)
+// Write a file under dir for cgroup_quota to read, made_files keeps track for cleaning up
+static void write_file(const std::string& path, const std::string& line, std::vector<std::string>& made_files)
+{
+	std::ofstream(path) << line << "\n";
+	made_files.push_back(path);
+}
+#endif
+
+static void test_cgroup_quota()
+{
+	check(cpu_max_cpus("max 100000") == 0, "cgroup v2 quota of max");
+	check(cpu_max_cpus("200000 100000") == 2, "cgroup v2 quota of 2 CPUs");
+	check(cpu_max_cpus("150000 100000") == 2, "cgroup v2 quota rounded up");
+	check(cpu_max_cpus("50000 100000") == 1, "cgroup v2 quota below one CPU");
+	check(cpu_max_cpus("") == 0 && cpu_max_cpus("garbage") == 0, "cgroup v2 quota that can't be read");
+	check(quota_cpus("-1", "100000") == 0, "cgroup v1 quota of -1");
+	check(quota_cpus("300000", "100000") == 3, "cgroup v1 quota of 3 CPUs");
+	check(quota_cpus("300000", "") == 0, "cgroup v1 quota without a period");
+
+#if defined(__linux__)
+	// A cgroup and its parents, the smallest quota on the path applies
+	char root_template[] = "/tmp/threaded_rands_cgroup_XXXXXX";
+	if(mkdtemp(root_template) == nullptr)
+	{
+		check(false, "cgroup test directory");
+		return;
+	}
+
+	const std::string root = root_template;
+	const std::vector<std::string> dirs = {root + "/v1", root + "/v1/a", root + "/v1/a/b", root + "/v2", root + "/v2/a", root + "/v2/a/b"};
+	for(const std::string& dir : dirs)
+		mkdir(dir.c_str(), 0700);
+
+	std::vector<std::string> made_files;
+	write_file(root + "/v1/cpu.cfs_quota_us", "-1", made_files);
+	write_file(root + "/v1/cpu.cfs_period_us", "100000", made_files);
+	write_file(root + "/v1/a/cpu.cfs_quota_us", "250000", made_files);
+	write_file(root + "/v1/a/cpu.cfs_period_us", "100000", made_files);
+	write_file(root + "/v1/a/b/cpu.cfs_quota_us", "-1", made_files);
+	write_file(root + "/v1/a/b/cpu.cfs_period_us", "100000", made_files);
+
+	write_file(root + "/v2/cpu.max", "max 100000", made_files);
+	write_file(root + "/v2/a/cpu.max", "150000 100000", made_files);
+	write_file(root + "/v2/a/b/cpu.max", "400000 100000", made_files);
+
+	check(cgroup_quota(root + "/v1", "/a/b", false) == 3, "cgroup v1 quota from a parent");
+	check(cgroup_quota(root + "/v1", "/", false) == 0, "cgroup v1 root without a quota");
+	check(cgroup_quota(root + "/v2", "/a/b", true) == 2, "cgroup v2 smallest quota on the path");
+	check(cgroup_quota(root + "/v2", "/", true) == 0, "cgroup v2 root without a quota");
+	check(cgroup_quota(root + "/missing", "/a", true) == 0, "cgroup without any files");
+
+	for(const std::string& file : made_files)
+		unlink(file.c_str());
+	for(auto dir = dirs.rbegin(); dir != dirs.rend(); ++dir)
+		rmdir(dir->c_str());
+	rmdir(root.c_str());
+#endif
+}
+
+// ======================================
+// 				Float ranges
+// ======================================
+
+static void test_float_range()
+{
+	Threaded_rands<std::uint64_t, std::uint64_t> t(1, generator_type::philox, 3);
+
+	std::vector<float> out(10000);
+	const float widest = std::numeric_limits<float>::max();
+	t.generate_floats(out, -widest, widest);
+
+	bool ok = true;
+	for(const float f : out)
+		ok = ok && std::isfinite(f) && f >= -widest && f < widest;
+	check(ok, "float range wider than FLT_MAX");
+
+	t.generate_floats(out, 1.0f, 2.0f);
+	ok = true;
+	for(const float f : out)
+		ok = ok && f >= 1.0f && f < 2.0f;
+	check(ok, "float range [1:2)");
+}
+
+// The low half of each xoroshiro128+ rand is weak, so its rands are mixed before
+// being split into floats. The floats of a block match its rands put through
+// mix_low_bits, through the SIMD kernel and on the scalar 32-bit generator
+static void test_mixed_floats()
+{
+	const std::size_t n = 1001;
+	const std::uint64_t first_block = std::uint64_t(1) << 63;
+
+	Threaded_rands<std::uint64_t, std::uint64_t> t(1, generator_type::xoro128, 7);
+	t.set_partition(partition_type::block, 1 << 16);
+
+	std::vector<float> floats(2 * n + 1);
+	t.generate_floats(floats.data(), floats.size());
+
+	auto g = xoroshiro128<std::uint64_t>::substream(7, first_block);
+	std::vector<std::uint64_t> raw(n + 1);
+	g.fill(simd::int_out<std::uint64_t>{raw.data()}, n);
+	g.fill(simd::int_out<std::uint64_t>{raw.data() + n}, 1);
+
+	bool ok = true;
+	for(std::size_t i = 0; i < n; i++)
+	{
+		const std::uint64_t x = simd::mix_low_bits(raw[i]);
+		ok = ok && floats[2 * i] == simd::to_float(static_cast<std::uint32_t>(x)) &&
+			 floats[2 * i + 1] == simd::to_float(static_cast<std::uint32_t>(x >> 32));
+	}
+	ok = ok && floats[2 * n] == simd::to_float(static_cast<std::uint32_t>(simd::mix_low_bits(raw[n])));
+	check(ok, "xoroshiro128+ floats are mixed");
+
+	Threaded_rands<std::uint32_t, std::uint32_t> t32(1, generator_type::xoro128, 7);
+	t32.set_partition(partition_type::block, 1 << 16);
+
+	std::vector<float> floats32(n);
+	t32.generate_floats(floats32.data(), floats32.size());
+
+	auto g32 = xoroshiro128<std::uint32_t>::substream(7, first_block);
+	ok = true;
+	for(const float f : floats32)
+		ok = ok && f == simd::to_float(simd::mix_low_bits(g32.get_rand()));
+	check(ok, "32-bit xoroshiro128+ floats are mixed");
+}
+
+// ======================================
+// 				  Digest
+// ======================================
+
+// A hash of seeded fills through every kernel, which should be the same at every SIMD level
+static std::uint64_t digest()
+{
+	std::uint64_t hash = 0xcbf29ce484222325;
+	auto add = [&](const void* data, const std::size_t bytes)
+	{
+		const unsigned char* p = static_cast<const unsigned char*>(data);
+		for(std::size_t i = 0; i < bytes; i++)
+			hash = (hash ^ p[i]) * 0x100000001b3;
+	};
+
+	const generator_type seeded[] = {generator_type::pcg_setseq, generator_type::philox, generator_type::threefry,
+									 generator_type::threefry13, generator_type::xoshiro256pp, generator_type::xoshiro256ss,
+									 generator_type::sfc};
+
+	for(const generator_type sel : seeded)
+	{
+		Threaded_rands<std::uint64_t, std::uint64_t> t(1, sel, 99);
+
+		std::vector<std::uint64_t> ints(10007);
+		t.generate(ints.data(), ints.size());
+		add(ints.data(), ints.size() * sizeof(std::uint64_t));
+
+		std::vector<double> doubles(5003);
+		t.generate_doubles(doubles.data(), doubles.size());
+		add(doubles.data(), doubles.size() * sizeof(double));
+
+		std::vector<float> floats(5003);
+		t.generate_floats(floats.data(), floats.size(), -1.5f, 2.5f);
+		add(floats.data(), floats.size() * sizeof(float));
+
+		// pdep at the avx2 level and up, the software deposit below
+		std::vector<std::uint64_t> words(1001);
+		t.generate_bernoulli(words.data(), words.size(), 0.3);
+		add(words.data(), words.size() * sizeof(std::uint64_t));
+	}
+
+	Threaded_rands<std::uint32_t, std::uint32_t> t32(1, generator_type::pcg_setseq, 99);
+	std::vector<std::uint32_t> ints32(10007);
+	t32.generate(ints32.data(), ints32.size());
+	add(ints32.data(), ints32.size() * sizeof(std::uint32_t));
+
+	return hash;
+}
+
+int main(int argc, char* argv[])
+{
+	if(argc > 1 && std::string(argv[1]) == "--digest")
+	{
+		std::printf("digest %016llx\n", static_cast<unsigned long long>(digest()));
+		return 0;
+	}
+
+	test_kernels_against_scalar();
+	test_doubles();
+	test_ranges();
+	test_narrow_ints();
+	test_bernoulli();
+	test_fill_bytes();
+	test_philox();
+	test_threefry();
+	test_xoshiro<false>();
+	test_xoshiro<true>();
+	test_sfc();
+	test_chacha();
+	test_get_rand_at();
+	test_block_partition();
+	test_block_streams();
+	test_thread_counts();
+	test_pool_run();
+	test_pool_tasks();
+	test_cgroup_quota();
+	test_cpu_list();
+	test_spread();
+	test_float_range();
+	test_mixed_floats();
+
+	std::printf("%s: %u failed\n", Threaded_rands<std::uint64_t, std::uint64_t>::simd_path(), n_failed);
+
+	return n_failed == 0 ? 0 : 1;
+}